@@ -0,0 +1,62 @@
+#include "blockcache.h"
+
+#include <string.h>
+
+void initialize_block_cache(BlockCache *cache) {
+	memset(cache->by_address, 0, sizeof(cache->by_address));
+	memset(cache->code_pages, 0, sizeof(cache->code_pages));
+	cache->blocks_used = 0;
+	cache->instructions_used = 0;
+	cache->idle_watch.block = NULL;
+	cache->native_used = 0; /* every block translated into it has just been thrown away, so the JIT can start writing over them */
+}
+
+Block *allocate_block(BlockCache *cache, uint16_t start) {
+	if(cache->blocks_used == MAX_BLOCKS || cache->instructions_used + BLOCK_MAX_INSTRUCTIONS > MAX_DECODED_INSTRUCTIONS) {
+		/* Space Invaders only ever runs a few hundred blocks, so running out means code is being rewritten all the time. Starting over
+		 * is simpler than working out which blocks are still in use, and costs no more than decoding the live ones again. */
+		initialize_block_cache(cache);
+	}
+
+	Block *block = &cache->blocks[cache->blocks_used++];
+	block->instructions = &cache->instructions[cache->instructions_used];
+	block->start = start;
+	block->cycles = 0;
+	block->bytes = 0;
+	block->length = 0;
+	block->in_ram = 0;
+	block->native_length = 0;
+	block->runs = 0;
+	block->native = NULL;
+	block->fused = 0;
+	block->may_idle = 0;
+	cache->instructions_used += BLOCK_MAX_INSTRUCTIONS;
+	cache->by_address[start] = block;
+	return block;
+}
+
+void finish_block(BlockCache *cache, Block *block, int in_ram) {
+	cache->instructions_used -= BLOCK_MAX_INSTRUCTIONS - block->length;
+	block->in_ram = in_ram;
+
+	if(in_ram) {
+		int addr;
+		for(addr = block->start; addr < block->start + block->bytes; addr += 1 << CODE_PAGE_SHIFT) {
+			cache->code_pages[(addr & 0xffff) >> CODE_PAGE_SHIFT] = 1;
+		}
+		addr = block->start + block->bytes - 1; /* the loop can step over the page holding the last byte */
+		cache->code_pages[(addr & 0xffff) >> CODE_PAGE_SHIFT] = 1;
+	}
+}
+
+void invalidate_code(BlockCache *cache, uint16_t addr) {
+	int i;
+	/* blocks are never longer than BLOCK_MAX_BYTES, so only ones starting that close before addr can contain it */
+	for(i = 0; i < BLOCK_MAX_BYTES; ++i) {
+		uint16_t start = addr - i;
+		Block *block = cache->by_address[start];
+		if(block != NULL && i < block->bytes) {
+			cache->by_address[start] = NULL; /* the record itself stays intact, in case it is the block being executed right now */
+		}
+	}
+}
@@ -0,0 +1,76 @@
+#ifndef SPINV_BLOCKCACHE
+#define SPINV_BLOCKCACHE
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define BLOCK_MAX_INSTRUCTIONS 32
+#define BLOCK_MAX_BYTES (BLOCK_MAX_INSTRUCTIONS * 3)
+
+#define MAX_BLOCKS 4096
+#define MAX_DECODED_INSTRUCTIONS 32768
+
+#define CODE_PAGE_SHIFT 6 /* RAM is tracked in 64-byte pages, so that writes to pages holding no cached code stay cheap */
+#define NUM_OF_CODE_PAGES (0x10000 >> CODE_PAGE_SHIFT)
+
+/* An instruction, decoded once so that running it again needs no table lookups and no operand reassembly. */
+typedef struct {
+	const void *handler; /* where the threaded core jumps to run this instruction. unused by the switch core */
+	uint16_t operand;    /* the immediate byte or word, if the instruction has one */
+	uint16_t next_pc;    /* the address of the following instruction, which PC is set to before the handler runs */
+	uint8_t  op;
+	uint8_t  cycles;
+} DecodedInstruction;
+
+/* A basic block: a straight run of instructions which only the last one can branch out of. */
+typedef struct {
+	DecodedInstruction *instructions;
+	uint16_t start;
+	uint16_t cycles; /* the sum of every instruction's cycles, assuming conditional calls and returns are taken */
+	uint8_t  bytes;  /* the number of bytes of memory the block was decoded from */
+	uint8_t  length; /* the number of instructions */
+	uint8_t  in_ram; /* 1 if any of it was decoded from RAM, which may be written over */
+	uint8_t  native_length; /* the number of instructions, from the start, that native covers */
+	uint16_t runs;   /* how many times the block has been entered, until it is hot enough to translate */
+	void (*native)(void *cpu, uint8_t *mem); /* the block translated to host code by the JIT, or NULL */
+	uint8_t  fused;  /* the fused loop the block is one whole iteration of, or 0. see FusedLoop in cpu8080.c */
+	uint8_t  may_idle; /* 1 if the block jumps back to its own start and has no effect but on registers, so it idles once an iteration changes nothing */
+} Block;
+
+/* What the idle loop detector saw as the last block was entered. See is_idling() in cpu8080.c. */
+typedef struct {
+	const Block *block; /* the last block entered, if it may idle. NULL otherwise */
+	uint8_t registers[7]; /* B, C, D, E, H, L and A as that block was entered */
+	uint16_t sp;
+	uint8_t flags;
+} IdleWatch;
+
+/* Everything here belongs to one CPU, so that several can run side by side. */
+typedef struct {
+	Block *by_address[0x10000]; /* the block starting at each address, or NULL if none has been decoded there */
+	uint8_t code_pages[NUM_OF_CODE_PAGES]; /* 1 for each page of RAM that cached code has been decoded from */
+	Block blocks[MAX_BLOCKS];
+	DecodedInstruction instructions[MAX_DECODED_INSTRUCTIONS];
+	int blocks_used;
+	int instructions_used;
+	IdleWatch idle_watch; /* kept here since it points into blocks, and must forget them whenever they are thrown away */
+	uint8_t *native_code; /* where the JIT writes this cache's translated blocks, or NULL if there is no JIT */
+	size_t native_used;
+} BlockCache;
+
+/* empties the cache, along with the JIT's buffer. native_code itself is left to the JIT to set up */
+void initialize_block_cache(BlockCache *cache);
+
+/* reserves a block starting at start, with room for BLOCK_MAX_INSTRUCTIONS. If the cache is full, everything in it is thrown away first. */
+Block *allocate_block(BlockCache *cache, uint16_t start);
+/* returns the unused instruction slots of a freshly decoded block, and starts watching its memory for writes if it lies in RAM */
+void finish_block(BlockCache *cache, Block *block, int in_ram);
+
+/* drops every block that was decoded from addr. Call it when addr is written to, if code_pages says it holds cached code. */
+void invalidate_code(BlockCache *cache, uint16_t addr);
+
+static inline Block *find_block(BlockCache *cache, uint16_t addr) {
+	return cache->by_address[addr];
+}
+
+#endif
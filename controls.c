@@ -1,43 +1,180 @@
 #include "controls.h"
+#include "pacing.h"
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
 //#include <threads.h>
 //#include "c11threads/threads.h"
 
-#define SET_CONTROL(control, value)                                                    \
-do {                                                                                   \
-	if(control != value) {                                                             \
-		success = pthread_mutex_lock(&game_control->mutex);                            \
-		if(success != 0) { /* TODO */                                                  \
-			fprintf(stderr, "ERROR: Failed to lock control mutex before writing.\n");  \
-		}                                                                              \
-		control = value;                                                               \
-		success = pthread_mutex_unlock(&game_control->mutex);                          \
-		if(success != 0) { /* TODO */                                                  \
-			fprintf(stderr, "ERROR: Failed to unlock control mutex after writing.\n"); \
-		}                                                                              \
-	}                                                                                  \
-} while(0);
+//#define CONTROLS_PRINT_INPUTS // this flag prints each input as it reaches the game, and the cycle it does so on.
+
+void queue_input(GameControl *game_control, uint32_t bits, int pressed) {
+	unsigned int head = atomic_load_explicit(&game_control->head, memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&game_control->tail, memory_order_acquire);
+	if(head - tail == INPUT_QUEUE_SIZE) {
+		fprintf(stderr, "WARNING: input queue is full. Dropping input.\n");
+		return;
+	}
+
+	InputEvent *event = &game_control->queue[head % INPUT_QUEUE_SIZE];
+	event->inputs = bits;
+	event->pressed = pressed;
+	event->cycle = 0;
+	clock_gettime(CLOCK_MONOTONIC, &event->queued);
+	atomic_store_explicit(&game_control->head, head + 1, memory_order_release); /* publishes the event */
+}
+
+/* Stamps event with the cycle it reaches the game on, records it, and returns inputs with it applied. */
+static uint32_t apply_input(GameControl *game_control, InputEvent *event, uint32_t inputs, unsigned long long cycle) {
+	event->cycle = cycle;
+	if(game_control->record != NULL) {
+		fprintf(game_control->record, "%llu %.4x %d\n", event->cycle, event->inputs, event->pressed);
+	}
+	#ifdef CONTROLS_PRINT_INPUTS
+	fprintf(stdout, "Cycle %llu: inputs %.4x %s\n", event->cycle, event->inputs, event->pressed ? "pressed" : "released");
+	#endif
+	return event->pressed ? inputs | event->inputs : inputs & ~event->inputs;
+}
+
+/* Moves on to the next second's stats once a second of real time has passed, printing the last one's if any inputs were applied in it. */
+static void finish_second(GameControl *game_control, struct timespec *now) {
+	if(nanoseconds_between(&game_control->second_start, now) < NANOSECONDS_PER_SECOND) {
+		return;
+	}
+
+	InputStats *stats = &game_control->current;
+	if(stats->inputs > 0) {
+		fprintf(stderr, "Inputs: %lu applied, latency max %ld us mean %lld us\n", stats->inputs, stats->max_latency / 1000,
+			stats->total_latency / stats->inputs / 1000);
+	}
+
+	memset(stats, 0, sizeof(InputStats));
+	game_control->second_start = *now;
+}
+
+int apply_queued_inputs(GameControl *game_control, unsigned long long cycle) {
+	unsigned int tail = atomic_load_explicit(&game_control->tail, memory_order_relaxed);
+	unsigned int head = atomic_load_explicit(&game_control->head, memory_order_acquire);
+	int replaying = game_control->replay_next < game_control->replay_length;
+	struct timespec now;
+
+	if(game_control->print_stats) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		finish_second(game_control, &now);
+	}
+	if(tail == head && !(replaying && game_control->replay[game_control->replay_next].cycle <= cycle)) {
+		return 0;
+	}
+
+	uint32_t inputs = atomic_load_explicit(&game_control->inputs, memory_order_relaxed);
+	int count = 0;
+	for(; tail != head; ++tail) {
+		InputEvent *event = &game_control->queue[tail % INPUT_QUEUE_SIZE];
+		if(replaying) {
+			continue; /* the record stands in for the controls until it runs out */
+		}
+		inputs = apply_input(game_control, event, inputs, cycle);
+		++count;
+
+		if(game_control->print_stats) {
+			long latency = nanoseconds_between(&event->queued, &now);
+			game_control->current.inputs += 1;
+			game_control->current.total_latency += latency;
+			if(latency > game_control->current.max_latency) {
+				game_control->current.max_latency = latency;
+			}
+		}
+	}
+	while(game_control->replay_next < game_control->replay_length && game_control->replay[game_control->replay_next].cycle <= cycle) {
+		inputs = apply_input(game_control, &game_control->replay[game_control->replay_next++], inputs, cycle);
+		++count;
+	}
+	atomic_store_explicit(&game_control->inputs, inputs, memory_order_relaxed);
+	atomic_store_explicit(&game_control->tail, tail, memory_order_release); /* hands the slots back to the GUI thread */
+
+	if(game_control->record != NULL && count > 0) {
+		fflush(game_control->record); /* so that the record survives the emulator being killed */
+	}
+	return count;
+}
+
+int record_inputs(GameControl *game_control, const char *filename) {
+	game_control->record = fopen(filename, "w");
+	if(game_control->record == NULL) {
+		fprintf(stderr, "ERROR: unable to open file %s\n%s\n", filename, strerror(errno));
+		return -1;
+	}
+	fprintf(game_control->record, "# cycle, INPUT_ bits, 1 pressed or 0 released\n");
+	return 0;
+}
+
+int replay_inputs(GameControl *game_control, const char *filename) {
+	FILE *file = fopen(filename, "r");
+	if(file == NULL) {
+		fprintf(stderr, "ERROR: unable to open file %s\n%s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	size_t capacity = 0;
+	char line[128];
+	int line_number = 0;
+	while(fgets(line, sizeof(line), file) != NULL) {
+		++line_number;
+		if(line[0] == '#' || line[0] == '\n') {
+			continue;
+		}
+
+		if(game_control->replay_length == capacity) {
+			capacity = capacity == 0 ? 64 : capacity * 2;
+			InputEvent *replay = realloc(game_control->replay, capacity * sizeof(InputEvent));
+			if(replay == NULL) {
+				fprintf(stderr, "ERROR: unable to allocate memory for the inputs in %s\n", filename);
+				fclose(file);
+				return -1;
+			}
+			game_control->replay = replay;
+		}
+
+		InputEvent *event = &game_control->replay[game_control->replay_length];
+		int pressed;
+		if(sscanf(line, "%llu %x %d", &event->cycle, &event->inputs, &pressed) != 3 || (pressed != 0 && pressed != 1) ||
+		   (game_control->replay_length > 0 && event->cycle < event[-1].cycle)) {
+			fprintf(stderr, "ERROR: line %d of %s is not an input, or is out of order\n", line_number, filename);
+			fclose(file);
+			return -1;
+		}
+		event->pressed = pressed;
+		game_control->replay_length += 1;
+	}
+
+	fclose(file);
+	return 0;
+}
+
+unsigned long long next_replayed_input(GameControl *game_control) {
+	if(game_control->replay_next == game_control->replay_length) {
+		return ULLONG_MAX;
+	}
+	return game_control->replay[game_control->replay_next].cycle;
+}
 
 /* TODO DELETE */
 static uint8_t *mem;
 
-void init_game_control(GameControl *game_control) {
-	game_control->credit = 0;
-	game_control->player1.start = 0;
-	game_control->player1.fire  = 0;
-	game_control->player1.left  = 0;
-	game_control->player1.right = 0;
-	game_control->player2.start = 0;
-	game_control->player2.fire  = 0;
-	game_control->player2.left  = 0;
-	game_control->player2.right = 0;
-	int success = pthread_mutex_init(&game_control->mutex, NULL);
-	if(success != 0) { /* TODO: check for individual error codes */
-		fprintf(stderr, "ERROR: Failed to initialize control mutex.");
-		exit(EXIT_FAILURE);
-	}
+void init_game_control(GameControl *game_control, int print_stats) {
+	atomic_init(&game_control->inputs, INPUT_PORT1_ALWAYS_SET); /* nothing held */
+	atomic_init(&game_control->head, 0);
+	atomic_init(&game_control->tail, 0);
+	game_control->record = NULL;
+	game_control->replay = NULL;
+	game_control->replay_length = 0;
+	game_control->replay_next = 0;
+	game_control->print_stats = print_stats;
+	clock_gettime(CLOCK_MONOTONIC, &game_control->second_start);
+	memset(&game_control->current, 0, sizeof(InputStats));
 }
 
 /* TODO DELETE */
@@ -46,10 +183,13 @@ void set_control_debug_memory_pointer(uint8_t *memory) {
 }
 
 void destroy_game_control(GameControl *game_control) {
-	pthread_mutex_destroy(&game_control->mutex); /* TODO: check failure */
+	if(game_control->record != NULL) {
+		fclose(game_control->record);
+	}
+	free(game_control->replay);
 }
 
-static void dump_vram() {
+void dump_vram() {
 	int vram_start = 0x2400;
 	int vram_end = 0x4000;
 	int i, j;
@@ -61,45 +201,3 @@ static void dump_vram() {
 		fprintf(stdout, "\n");
 	}
 }
-
-static void key_press_event(GtkWidget *widget, GdkEventKey *event, gpointer data) {
-	GameControl *game_control = (GameControl *)data;
-	int success;
-	switch(event->keyval) {
-		case CREDIT:   SET_CONTROL(game_control->credit, 1);        break;
-		case P1_START: SET_CONTROL(game_control->player1.start, 1); break;
-		case P1_FIRE:  SET_CONTROL(game_control->player1.fire,  1); break;
-		case P1_LEFT:  SET_CONTROL(game_control->player1.left,  1); break;
-		case P1_RIGHT: SET_CONTROL(game_control->player1.right, 1); break;
-		case P2_START: SET_CONTROL(game_control->player2.start, 1); break;
-		case P2_FIRE:  SET_CONTROL(game_control->player2.fire,  1); break;
-		case P2_LEFT:  SET_CONTROL(game_control->player2.left,  1); break;
-		case P2_RIGHT: SET_CONTROL(game_control->player2.right, 1); break;
-		case DUMP_VRAM: dump_vram(); break;
-		default: break;
-	}
-}
-
-static void key_release_event(GtkWidget *widget, GdkEventKey *event, gpointer data) {
-	GameControl *game_control = (GameControl *)data;
-	int success;
-	switch(event->keyval) {
-		case CREDIT:   SET_CONTROL(game_control->credit, 0);        break;
-		case P1_START: SET_CONTROL(game_control->player1.start, 0); break;
-		case P1_FIRE:  SET_CONTROL(game_control->player1.fire,  0); break;
-		case P1_LEFT:  SET_CONTROL(game_control->player1.left,  0); break;
-		case P1_RIGHT: SET_CONTROL(game_control->player1.right, 0); break;
-		case P2_START: SET_CONTROL(game_control->player2.start, 0); break;
-		case P2_FIRE:  SET_CONTROL(game_control->player2.fire,  0); break;
-		case P2_LEFT:  SET_CONTROL(game_control->player2.left,  0); break;
-		case P2_RIGHT: SET_CONTROL(game_control->player2.right, 0); break;
-		default: break;
-	}
-}
-
-void set_control_events(GtkWidget *widget, GameControl *game_control) {
-	g_signal_connect(widget, "key-press-event", G_CALLBACK(key_press_event), game_control);
-	g_signal_connect(widget, "key-release-event", G_CALLBACK(key_release_event), game_control);
-
-	gtk_widget_set_events(widget, gtk_widget_get_events(widget) | GDK_KEY_PRESS_MASK | GDK_KEY_RELEASE_MASK);
-}
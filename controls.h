@@ -1,50 +1,88 @@
 #ifndef SPINV_CONTROLS
 #define SPINV_CONTROLS
 
-#include <gtk/gtk.h>
-#include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <time.h>
 
-/* Key codes obtained from gdk/gdkkeysyms.h */
+/* Bits of the packed input word. The low byte is laid out exactly as input port 1 reads, and the byte above it as input port 2, so reading
+ * a port is just a shift and a mask. */
+#define INPUT_CREDIT   0x0001
+#define INPUT_P2_START 0x0002
+#define INPUT_P1_START 0x0004
+#define INPUT_PORT1_ALWAYS_SET 0x0008 /* port 1 bit 3 always reads as 1 */
+#define INPUT_P1_FIRE  0x0010
+#define INPUT_P1_LEFT  0x0020
+#define INPUT_P1_RIGHT 0x0040
+#define INPUT_P2_FIRE  0x1000
+#define INPUT_P2_LEFT  0x2000
+#define INPUT_P2_RIGHT 0x4000
 
-#define CREDIT GDK_KEY_c
+#define INPUT_PORT1_SHIFT 0
+#define INPUT_PORT2_SHIFT 8
 
-#define P1_START GDK_KEY_Return
-#define P1_FIRE GDK_KEY_space
-#define P1_LEFT GDK_KEY_Left
-#define P1_RIGHT GDK_KEY_Right
+#define INPUT_QUEUE_SIZE 256 /* must be a power of two */
 
-#define P2_START GDK_KEY_KP_Enter
-#define P2_FIRE GDK_KEY_KP_0
-#define P2_LEFT GDK_KEY_KP_4
-#define P2_RIGHT GDK_KEY_KP_6
-
-/* Debug controls */
-#define DUMP_VRAM GDK_KEY_v
+/* A control being pressed or released. The display backend queues these as keys go up and down, and the CPU thread applies them between batches,
+ * stamping each with the emulated cycle it took effect on. */
+typedef struct {
+	uint32_t inputs; /* the INPUT_ bits that changed */
+	uint8_t pressed; /* 1 if they were pressed, 0 if released */
+	unsigned long long cycle; /* set once the event has been applied. for a replayed event, the cycle it is due on */
+	struct timespec queued; /* when the event was queued, by CLOCK_MONOTONIC */
+} InputEvent;
 
-/* represents all controls for a single player */
+/* How long inputs took to reach the game after being queued, over one second of real time. */
 typedef struct {
-	uint8_t start:1;
-	uint8_t fire:1;
-	uint8_t left:1;
-	uint8_t right:1;
-	uint8_t padding:4;
-} PlayerControl;
-
-/* represents all controls available in the game */
+	unsigned long inputs; /* how many were applied */
+	long max_latency;     /* in nanoseconds */
+	long long total_latency;
+} InputStats;
+
+/* represents all controls available in the game. Events pass from the GUI thread to the CPU thread through a single-producer, single-
+ * consumer ring buffer: each side only ever moves its own index, so neither needs a lock. Only the CPU thread changes the input word.
+ * Every event applied can be recorded, along with the cycle it was applied on, and a record can be replayed in place of the controls. Since
+ * nothing else the CPU sees depends on the host, replaying a record runs the game exactly as it ran when it was recorded. */
 typedef struct {
-	uint8_t credit;
-	PlayerControl player1;
-	PlayerControl player2;
-	pthread_mutex_t mutex; /* Controls are currently only set from one thread. Better to be safe anyway. */
+	atomic_uint_least32_t inputs; /* INPUT_ bits for every control being held */
+	InputEvent queue[INPUT_QUEUE_SIZE];
+	atomic_uint head; /* where the GUI thread queues the next event */
+	atomic_uint tail; /* where the CPU thread reads the next event from. equal to head when the queue is empty */
+	FILE *record; /* each event applied is written here, or NULL */
+	InputEvent *replay; /* events read back from a record, in the order they are due, or NULL */
+	size_t replay_length;
+	size_t replay_next; /* the next one due. queued events are dropped until every one has been applied */
+	int print_stats; /* 1 to print each second's InputStats, for seconds in which inputs were applied */
+	struct timespec second_start;
+	InputStats current;
 } GameControl;
 
-void init_game_control(GameControl *game_control);
+void init_game_control(GameControl *game_control, int print_stats);
+/* closes the record, if there is one */
 void destroy_game_control(GameControl *game_control);
 
-void set_control_events(GtkWidget *widget, GameControl *game_control);
+/* Writes each event applied from now on to filename, one line each: the cycle it was applied on, its INPUT_ bits in hex, and 1 for pressed or 0
+ * for released. Returns 0 on success. On failure an error is printed, and -1 returned. */
+int record_inputs(GameControl *game_control, const char *filename);
+/* Reads back a record written by record_inputs(), for its events to be applied on the cycles they were recorded on. Returns 0 on success. On
+ * failure, including a record that is out of order, an error is printed and -1 returned. */
+int replay_inputs(GameControl *game_control, const char *filename);
+/* The cycle the next replayed event is due on, or ULLONG_MAX if there is none. Batches must end there for it to be applied on exactly that
+ * cycle. A record's cycles are always ones a batch ended on already. */
+unsigned long long next_replayed_input(GameControl *game_control);
+
+/* Queues a press or release of the controls in bits, for the CPU thread to apply. Call from the display backend's thread only. */
+void queue_input(GameControl *game_control, uint32_t bits, int pressed);
+
+/* Applies every event queued since the last call, and every replayed event due by then, as of the given emulated cycle. Call from the CPU
+ * thread only, between batches, so that an input always reaches the game on a cycle that depends on the run alone, at most a batch after it
+ * was queued. Returns how many were applied. */
+int apply_queued_inputs(GameControl *game_control, unsigned long long cycle);
 
 /* TODO DELETE */
 void set_control_debug_memory_pointer(uint8_t *memory);
+/* prints VRAM as it stands, one line of bits at a time */
+void dump_vram();
 
 #endif
@@ -2,6 +2,7 @@
 #include "disassembler8080.h"
 #include "ports.h"
 #include "interrupts.h"
+#include "jit_x86_64.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -9,9 +10,28 @@
 
 //#define CPU_DEBUG // this flag enables stepping through instructions, and prints extensive information about the CPU.
 //#define CPU_PRINT // this flag enables a print-out of the current PC and instruction being executed.
+//#define CPU_SWITCH_DISPATCH // this flag forces the portable switch-based core, even when the compiler supports the threaded one.
+//#define CPU_EAGER_FLAGS // this flag disables lazy flag evaluation, so that every flag is computed as soon as an instruction sets it.
+//#define CPU_JIT // this flag enables translating hot blocks of ROM code to native code. x86-64 only, and ignored along with the flags above.
+//#define CPU_NO_FUSED_LOOPS // this flag disables running the ROM's copy and clear loops many iterations at a time.
+//#define CPU_NO_IDLE_SKIP // this flag disables skipping over loops that only wait for an interrupt.
+//#define CPU_RECOMPILED // this flag runs the ROM from recompiled_rom.c, generated by spinv_recompile, and only interprets what it does not cover.
 
-void initializeOpLengths(uint8_t *lengths);
-void initializeOpCycles(uint8_t *cycles);
+#if defined(__GNUC__) && !defined(CPU_SWITCH_DISPATCH)
+#define CPU_THREADED_DISPATCH /* GCC and Clang support computed goto (labels as values), which the threaded core is built on */
+#endif
+
+#if defined(CPU_JIT) && defined(__x86_64__) && !defined(CPU_EAGER_FLAGS) && !defined(CPU_DEBUG) && !defined(CPU_PRINT)
+#define CPU_JIT_ENABLED /* translated code only knows how to record flags lazily, and cannot stop to print or debug each instruction */
+#endif
+
+#if !defined(CPU_NO_FUSED_LOOPS) && !defined(CPU_DEBUG) && !defined(CPU_PRINT)
+#define CPU_FUSED_LOOPS_ENABLED /* fused loops skip over the instructions they run, so there is nothing to print or step through */
+#endif
+
+#if !defined(CPU_NO_IDLE_SKIP) && !defined(CPU_DEBUG) && !defined(CPU_PRINT)
+#define CPU_IDLE_SKIP_ENABLED /* likewise for idle loops */
+#endif
 
 uint16_t to_double_word(uint8_t low, uint8_t high);
 void from_double_word(uint16_t dword, uint8_t *low, uint8_t *high);
@@ -22,18 +42,16 @@ void stack_pop(CPU *cpu, uint8_t *mem, uint8_t *byte1, uint8_t *byte2);
 void call(CPU *cpu, uint8_t *mem, uint16_t addr);
 void ret(CPU *cpu, uint8_t *mem);
 
-uint8_t *get_register(CPU *cpu, uint8_t *mem, char reg);
+void initializeZSPFlags(uint8_t *table);
 
-void set_z(Flags *flags, uint16_t result);
-void set_s(Flags *flags, uint16_t result);
-void set_p(Flags *flags, uint16_t result);
+void set_zsp(Flags *flags, uint8_t result);
 void set_cy(Flags *flags, uint16_t result);
 
 uint8_t two_comp(uint8_t i); /* efficiently returns two's complement of a byte. */
 
 static uint8_t opLengths[NUM_OF_OPCODES];
 static uint8_t opCycles[NUM_OF_OPCODES];
-static uint8_t cycle_override;
+static uint8_t zspFlags[0x100]; /* the Z, S and P bits that each possible 8-bit result produces, already in their PSW positions */
 
 /* These default values may not be correct, but I think the program sets the values of registers, flags, SP and PC anyway before they get used. */
 void initializeCPU(CPU *cpu) {
@@ -46,21 +64,47 @@ void initializeCPU(CPU *cpu) {
 	cpu->a = 0;
 	cpu->sp = 0; /* stack pointer gets set by the program itself */
 	cpu->pc = 0;
-	cpu->flags.z = 0;
-	cpu->flags.s = 0;
-	cpu->flags.p = 0;
-	cpu->flags.cy = 0;
-	cpu->flags.ac = 0;
+	cpu->flags = FLAG_ALWAYS_SET;
+	cpu->lazy_flags.pending = 0;
 	memset(&cpu->interrupt_instruction[0], 0x00, 3);
 	//cpu->inte = 1;
 	cpu->has_interrupt = 0;
 	cpu->halted = 0;
+	memset(cpu->vram_dirty, 1, sizeof(cpu->vram_dirty)); /* nothing has been taken from VRAM yet */
 
 	initializeOpLengths(opLengths);
 	initializeOpCycles(opCycles);
+	initializeZSPFlags(zspFlags);
+
+	/* cycles are only looked up when an instruction is decoded, so check up front that every implemented instruction has been given some */
+	#define OP(code, ...)                                                                                                 \
+	if(opCycles[code] == 255) {                                                                                           \
+		fprintf(stderr, "WARNING: the number of cycles has been improperly set for operation %x. Exiting.\n", code);     \
+		exit(1);                                                                                                          \
+	}
+	#include "cpu8080_ops.h"
+
+	cpu->block_cache = malloc(sizeof(BlockCache));
+	if(cpu->block_cache == NULL) {
+		fprintf(stderr, "ERROR: Unable to allocate the block cache.\n");
+		exit(EXIT_FAILURE);
+	}
+	initialize_block_cache(cpu->block_cache);
+
+	#ifdef CPU_JIT_ENABLED
+	initialize_jit(cpu->block_cache);
+	#endif
+}
+
+void destroyCPU(CPU *cpu) {
+	#ifdef CPU_JIT_ENABLED
+	destroy_jit(cpu->block_cache);
+	#endif
+	free(cpu->block_cache);
 }
 
 void printCPU(CPU *cpu, uint8_t *mem) {
+	materialize_flags(cpu);
 	fprintf(stdout, "#--- CPU ------------\n");
 	fprintf(stdout, "| Registers:\n| B: 0x%.2x    H: 0x%.2x\n", cpu->b, cpu->h);
 	fprintf(stdout, "| C: 0x%.2x    L: 0x%.2x\n", cpu->c, cpu->l);
@@ -71,7 +115,7 @@ void printCPU(CPU *cpu, uint8_t *mem) {
 	fprintf(stdout, "| Stack Pointer: 0x%.4x\n", cpu->sp);
 	fprintf(stdout, "| Program Counter: 0x%.4x\n", cpu->pc);
 	fprintf(stdout, "#--------------------\n");
-	fprintf(stdout, "| Flags:\n| z: %x  s: %x  p: %x  cy: %x  ac: %x\n", cpu->flags.z, cpu->flags.s, cpu->flags.p, cpu->flags.cy, cpu->flags.ac);
+	fprintf(stdout, "| Flags:\n| z: %x  s: %x  p: %x  cy: %x  ac: %x\n", (cpu->flags & FLAG_Z) >> 6, (cpu->flags & FLAG_S) >> 7, (cpu->flags & FLAG_P) >> 2, cpu->flags & FLAG_CY, (cpu->flags & FLAG_AC) >> 4);
 	fprintf(stdout, "#--------------------\n");
 }
 
@@ -87,721 +131,784 @@ void printOpcodeInfo(uint16_t current_pc, uint8_t *opcode) {
 	//fprintf(stdout, "#--------------------\n");
 }
 
-uint8_t emulate(CPU *cpu, uint8_t *mem, Interrupt *interrupts) {
+/* Sets Z, S and P from an 8-bit result, and AC from the carry out of bit 3 when the low half of ac_lhs is added to ac_rhs. Callers pass ac_rhs
+ * already reduced to a half-byte (plus any carry in), as each operation has its own idea of what gets added to the low half of A.
+ * In lazy mode this only records its arguments; the flags are worked out later, if anything ever reads them. */
+static inline void set_zspac(CPU *cpu, uint8_t result, uint8_t ac_lhs, uint8_t ac_rhs) {
+	#ifdef CPU_EAGER_FLAGS
+	cpu->flags = (cpu->flags & FLAG_CY) | FLAG_ALWAYS_SET | zspFlags[result] | (((ac_lhs & 0x0f) + ac_rhs) & FLAG_AC);
+	#else
+	cpu->lazy_flags.result = result;
+	cpu->lazy_flags.ac_lhs = ac_lhs;
+	cpu->lazy_flags.ac_rhs = ac_rhs;
+	cpu->lazy_flags.pending = 1;
+	#endif
+}
 
-	if(cpu->halted) {
-		return opCycles[0x00]; // for the time being, we'll emulate a halted CPU as if it was just executing NOPs. It'll probably never come up.
+/* Brings z, s, p and ac in cpu->flags up to date with the last operation that set them. cy is always kept up to date. */
+void materialize_flags(CPU *cpu) {
+	if(cpu->lazy_flags.pending) {
+		uint8_t ac = ((cpu->lazy_flags.ac_lhs & 0x0f) + cpu->lazy_flags.ac_rhs) & FLAG_AC; /* the carry out of bit 3 lands on bit 4, which is where AC lives */
+		cpu->flags = (cpu->flags & FLAG_CY) | FLAG_ALWAYS_SET | zspFlags[cpu->lazy_flags.result] | ac;
+		cpu->lazy_flags.pending = 0;
 	}
+}
 
-	cycle_override = 255;
-
-	uint8_t *opcode;
-
-	if(cpu->has_interrupt) {
-		opcode = &cpu->interrupt_instruction[0];
-		cpu->has_interrupt = 0;
-	}
-	else {
-		opcode = &mem[cpu->pc];
-		cpu->pc += opLengths[opcode[0]];
+/* Conditional instructions only need one flag each, so these derive just that flag (as 0 or 1) rather than materializing all of them. */
+static inline uint8_t flag_z(CPU *cpu) {
+	if(cpu->lazy_flags.pending) {
+		return cpu->lazy_flags.result == 0;
 	}
+	return (cpu->flags & FLAG_Z) >> 6;
+}
 
-	#ifdef CPU_PRINT
-	char disassembled[32];
-	disassemble(opcode, disassembled);
-	if(cpu->has_interrupt) {
-		fprintf(stdout, "Interrupt! %s\n", disassembled);
-	}
-	else {
-		fprintf(stdout, "0x%.4x: %s\n", cpu->pc - opLengths[opcode[0]], disassembled);
+static inline uint8_t flag_s(CPU *cpu) {
+	if(cpu->lazy_flags.pending) {
+		return cpu->lazy_flags.result >> 7;
 	}
-	#endif
+	return (cpu->flags & FLAG_S) >> 7;
+}
 
-	switch(opcode[0]) { /* maybe make this a lookup table with function pointers? probably doesn't matter for an arcade emulator */
-		case 0x00: NOP(cpu); 											break;
-		case 0x01: LXI(cpu, 'B', to_double_word(opcode[1], opcode[2])); break;
-		case 0x02: STAX(cpu, mem, 'B'); 								break;
-		case 0x03: INX(cpu, 'B'); 										break;
-		case 0x04: INR(cpu, mem, 'B'); 									break;
-		case 0x05: DCR(cpu, mem, 'B'); 									break;
-		case 0x06: MVI(cpu, mem, 'B', opcode[1]); 						break;
-		case 0x07: RLC(cpu); 											break;
-		case 0x09: DAD(cpu, 'B'); 										break;
-		case 0x0a: LDAX(cpu, mem, 'B'); 								break;
-		case 0x0b: DCX(cpu, 'B'); 										break;
-		case 0x0c: INR(cpu, mem, 'C'); 									break;
-		case 0x0d: DCR(cpu, mem, 'C'); 									break;
-		case 0x0e: MVI(cpu, mem, 'C', opcode[1]); 						break;
-		case 0x0f: RRC(cpu); 											break;
-		case 0x11: LXI(cpu, 'D', to_double_word(opcode[1], opcode[2])); break;
-		case 0x12: STAX(cpu, mem, 'D'); 								break;
-		case 0x13: INX(cpu, 'D'); 										break;
-		case 0x14: INR(cpu, mem, 'D'); 									break;
-		case 0x15: DCR(cpu, mem, 'D'); 									break;
-		case 0x16: MVI(cpu, mem, 'D', opcode[1]); 						break;
-		case 0x17: RAL(cpu); 											break;
-		case 0x19: DAD(cpu, 'D'); 										break;
-		case 0x1a: LDAX(cpu, mem, 'D'); 								break;
-		case 0x1b: DCX(cpu, 'D'); 										break;
-		case 0x1c: INR(cpu, mem, 'E'); 									break;
-		case 0x1d: DCR(cpu, mem, 'E'); 									break;
-		case 0x1e: MVI(cpu, mem, 'E', opcode[1]); 						break;
-		case 0x1f: RAR(cpu); 											break;
-		case 0x20: RIM(cpu); 											break;
-		case 0x21: LXI(cpu, 'H', to_double_word(opcode[1], opcode[2])); break;
-		case 0x22: SHLD(cpu, mem, to_double_word(opcode[1], opcode[2])); break;
-		case 0x23: INX(cpu, 'H'); 										break;
-		case 0x24: INR(cpu, mem, 'H'); 									break;
-		case 0x25: DCR(cpu, mem, 'H'); 									break;
-		case 0x26: MVI(cpu, mem, 'H', opcode[1]); 						break;
-		case 0x27: DAA(cpu); 											break;
-		case 0x29: DAD(cpu, 'H'); 										break;
-		case 0x2a: LHLD(cpu, mem, to_double_word(opcode[1], opcode[2])); break;
-		case 0x2b: DCX(cpu, 'H'); 										break;
-		case 0x2c: INR(cpu, mem, 'L'); 									break;
-		case 0x2d: DCR(cpu, mem, 'L'); 									break;
-		case 0x2e: MVI(cpu, mem, 'L', opcode[1]); 						break;
-		case 0x2f: CMA(cpu); 											break;
-		case 0x30: SIM(cpu); 											break;
-		case 0x31: LXI(cpu, 'S', to_double_word(opcode[1], opcode[2])); break;
-		case 0x32: STA(cpu, mem, to_double_word(opcode[1], opcode[2])); break;
-		case 0x33: INX(cpu, 'S'); 										break;
-		case 0x34: INR(cpu, mem, 'M'); 									break;
-		case 0x35: DCR(cpu, mem, 'M'); 									break;
-		case 0x36: MVI(cpu, mem, 'M', opcode[1]); 						break;
-		case 0x37: STC(cpu); 											break;
-		case 0x39: DAD(cpu, 'S'); 										break;
-		case 0x3a: LDA(cpu, mem, to_double_word(opcode[1], opcode[2])); break;
-		case 0x3b: DCX(cpu, 'S'); 										break;
-		case 0x3c: INR(cpu, mem, 'A'); 									break;
-		case 0x3d: DCR(cpu, mem, 'A'); 									break;
-		case 0x3e: MVI(cpu, mem, 'A', opcode[1]); 						break;
-		case 0x3f: CMC(cpu); 											break;
-		case 0x40: MOV(cpu, mem, 'B', 'B'); 							break;
-		case 0x41: MOV(cpu, mem, 'B', 'C'); 							break;
-		case 0x42: MOV(cpu, mem, 'B', 'D'); 							break;
-		case 0x43: MOV(cpu, mem, 'B', 'E'); 							break;
-		case 0x44: MOV(cpu, mem, 'B', 'H'); 							break;
-		case 0x45: MOV(cpu, mem, 'B', 'L'); 							break;
-		case 0x46: MOV(cpu, mem, 'B', 'M'); 							break;
-		case 0x47: MOV(cpu, mem, 'B', 'A'); 							break;
-		case 0x48: MOV(cpu, mem, 'C', 'B'); 							break;
-		case 0x49: MOV(cpu, mem, 'C', 'C'); 							break;
-		case 0x4a: MOV(cpu, mem, 'C', 'D'); 							break;
-		case 0x4b: MOV(cpu, mem, 'C', 'E'); 							break;
-		case 0x4c: MOV(cpu, mem, 'C', 'H'); 							break;
-		case 0x4d: MOV(cpu, mem, 'C', 'L'); 							break;
-		case 0x4e: MOV(cpu, mem, 'C', 'M'); 							break;
-		case 0x4f: MOV(cpu, mem, 'C', 'A'); 							break;
-		case 0x50: MOV(cpu, mem, 'D', 'B'); 							break;
-		case 0x51: MOV(cpu, mem, 'D', 'C'); 							break;
-		case 0x52: MOV(cpu, mem, 'D', 'D'); 							break;
-		case 0x53: MOV(cpu, mem, 'D', 'E'); 							break;
-		case 0x54: MOV(cpu, mem, 'D', 'H'); 							break;
-		case 0x55: MOV(cpu, mem, 'D', 'L'); 							break;
-		case 0x56: MOV(cpu, mem, 'D', 'M'); 							break;
-		case 0x57: MOV(cpu, mem, 'D', 'A'); 							break;
-		case 0x58: MOV(cpu, mem, 'E', 'B'); 							break;
-		case 0x59: MOV(cpu, mem, 'E', 'C'); 							break;
-		case 0x5a: MOV(cpu, mem, 'E', 'D'); 							break;
-		case 0x5b: MOV(cpu, mem, 'E', 'E'); 							break;
-		case 0x5c: MOV(cpu, mem, 'E', 'H'); 							break;
-		case 0x5d: MOV(cpu, mem, 'E', 'L'); 							break;
-		case 0x5e: MOV(cpu, mem, 'E', 'M'); 							break;
-		case 0x5f: MOV(cpu, mem, 'E', 'A'); 							break;
-		case 0x60: MOV(cpu, mem, 'H', 'B'); 							break;
-		case 0x61: MOV(cpu, mem, 'H', 'C'); 							break;
-		case 0x62: MOV(cpu, mem, 'H', 'D'); 							break;
-		case 0x63: MOV(cpu, mem, 'H', 'E'); 							break;
-		case 0x64: MOV(cpu, mem, 'H', 'H'); 							break;
-		case 0x65: MOV(cpu, mem, 'H', 'L'); 							break;
-		case 0x66: MOV(cpu, mem, 'H', 'M'); 							break;
-		case 0x67: MOV(cpu, mem, 'H', 'A'); 							break;
-		case 0x68: MOV(cpu, mem, 'L', 'B'); 							break;
-		case 0x69: MOV(cpu, mem, 'L', 'C'); 							break;
-		case 0x6a: MOV(cpu, mem, 'L', 'D'); 							break;
-		case 0x6b: MOV(cpu, mem, 'L', 'E'); 							break;
-		case 0x6c: MOV(cpu, mem, 'L', 'H'); 							break;
-		case 0x6d: MOV(cpu, mem, 'L', 'L'); 							break;
-		case 0x6e: MOV(cpu, mem, 'L', 'M'); 							break;
-		case 0x6f: MOV(cpu, mem, 'L', 'A'); 							break;
-		case 0x70: MOV(cpu, mem, 'M', 'B'); 							break;
-		case 0x71: MOV(cpu, mem, 'M', 'C'); 							break;
-		case 0x72: MOV(cpu, mem, 'M', 'D'); 							break;
-		case 0x73: MOV(cpu, mem, 'M', 'E'); 							break;
-		case 0x74: MOV(cpu, mem, 'M', 'H'); 							break;
-		case 0x75: MOV(cpu, mem, 'M', 'L'); 							break;
-		case 0x76: HLT(cpu); 											break;
-		case 0x77: MOV(cpu, mem, 'M', 'A'); 							break;
-		case 0x78: MOV(cpu, mem, 'A', 'B'); 							break;
-		case 0x79: MOV(cpu, mem, 'A', 'C'); 							break;
-		case 0x7a: MOV(cpu, mem, 'A', 'D'); 							break;
-		case 0x7b: MOV(cpu, mem, 'A', 'E'); 							break;
-		case 0x7c: MOV(cpu, mem, 'A', 'H'); 							break;
-		case 0x7d: MOV(cpu, mem, 'A', 'L'); 							break;
-		case 0x7e: MOV(cpu, mem, 'A', 'M'); 							break;
-		case 0x7f: MOV(cpu, mem, 'A', 'A'); 							break;
-		case 0x80: ADD(cpu, mem, 'B'); 									break;
-		case 0x81: ADD(cpu, mem, 'C'); 									break;
-		case 0x82: ADD(cpu, mem, 'D'); 									break;
-		case 0x83: ADD(cpu, mem, 'E'); 									break;
-		case 0x84: ADD(cpu, mem, 'H'); 									break;
-		case 0x85: ADD(cpu, mem, 'L'); 									break;
-		case 0x86: ADD(cpu, mem, 'M'); 									break;
-		case 0x87: ADD(cpu, mem, 'A'); 									break;
-		case 0x88: ADC(cpu, mem, 'B'); 									break;
-		case 0x89: ADC(cpu, mem, 'C'); 									break;
-		case 0x8a: ADC(cpu, mem, 'D'); 									break;
-		case 0x8b: ADC(cpu, mem, 'E'); 									break;
-		case 0x8c: ADC(cpu, mem, 'H'); 									break;
-		case 0x8d: ADC(cpu, mem, 'L'); 									break;
-		case 0x8e: ADC(cpu, mem, 'M'); 									break;
-		case 0x8f: ADC(cpu, mem, 'A'); 									break;
-		case 0x90: SUB(cpu, mem, 'B'); 									break;
-		case 0x91: SUB(cpu, mem, 'C'); 									break;
-		case 0x92: SUB(cpu, mem, 'D'); 									break;
-		case 0x93: SUB(cpu, mem, 'E'); 									break;
-		case 0x94: SUB(cpu, mem, 'H'); 									break;
-		case 0x95: SUB(cpu, mem, 'L'); 									break;
-		case 0x96: SUB(cpu, mem, 'M'); 									break;
-		case 0x97: SUB(cpu, mem, 'A'); 									break;
-		case 0x98: SBB(cpu, mem, 'B'); 									break;
-		case 0x99: SBB(cpu, mem, 'C'); 									break;
-		case 0x9a: SBB(cpu, mem, 'D'); 									break;
-		case 0x9b: SBB(cpu, mem, 'E'); 									break;
-		case 0x9c: SBB(cpu, mem, 'H'); 									break;
-		case 0x9d: SBB(cpu, mem, 'L'); 									break;
-		case 0x9e: SBB(cpu, mem, 'M'); 									break;
-		case 0x9f: SBB(cpu, mem, 'A'); 									break;
-		case 0xa0: ANA(cpu, mem, 'B'); 									break;
-		case 0xa1: ANA(cpu, mem, 'C'); 									break;
-		case 0xa2: ANA(cpu, mem, 'D'); 									break;
-		case 0xa3: ANA(cpu, mem, 'E'); 									break;
-		case 0xa4: ANA(cpu, mem, 'H'); 									break;
-		case 0xa5: ANA(cpu, mem, 'L'); 									break;
-		case 0xa6: ANA(cpu, mem, 'M'); 									break;
-		case 0xa7: ANA(cpu, mem, 'A'); 									break;
-		case 0xa8: XRA(cpu, mem, 'B'); 									break;
-		case 0xa9: XRA(cpu, mem, 'C'); 									break;
-		case 0xaa: XRA(cpu, mem, 'D'); 									break;
-		case 0xab: XRA(cpu, mem, 'E'); 									break;
-		case 0xac: XRA(cpu, mem, 'H'); 									break;
-		case 0xad: XRA(cpu, mem, 'L'); 									break;
-		case 0xae: XRA(cpu, mem, 'M'); 									break;
-		case 0xaf: XRA(cpu, mem, 'A'); 									break;
-		case 0xb0: ORA(cpu, mem, 'B'); 									break;
-		case 0xb1: ORA(cpu, mem, 'C'); 									break;
-		case 0xb2: ORA(cpu, mem, 'D'); 									break;
-		case 0xb3: ORA(cpu, mem, 'E'); 									break;
-		case 0xb4: ORA(cpu, mem, 'H'); 									break;
-		case 0xb5: ORA(cpu, mem, 'L'); 									break;
-		case 0xb6: ORA(cpu, mem, 'M'); 									break;
-		case 0xb7: ORA(cpu, mem, 'A'); 									break;
-		case 0xb8: CMP(cpu, mem, 'B'); 									break;
-		case 0xb9: CMP(cpu, mem, 'C'); 									break;
-		case 0xba: CMP(cpu, mem, 'D'); 									break;
-		case 0xbb: CMP(cpu, mem, 'E'); 									break;
-		case 0xbc: CMP(cpu, mem, 'H'); 									break;
-		case 0xbd: CMP(cpu, mem, 'L'); 									break;
-		case 0xbe: CMP(cpu, mem, 'M'); 									break;
-		case 0xbf: CMP(cpu, mem, 'A'); 									break;
-		case 0xc0: RNZ(cpu, mem); 										break;
-		case 0xc1: POP(cpu, mem, 'B'); 									break;
-		case 0xc2: JNZ(cpu, to_double_word(opcode[1], opcode[2])); 		break;
-		case 0xc3: JMP(cpu, to_double_word(opcode[1], opcode[2])); 		break;
-		case 0xc4: CNZ(cpu, mem, to_double_word(opcode[1], opcode[2])); break;
-		case 0xc5: PUSH(cpu, mem, 'B'); 								break;
-		case 0xc6: ADI(cpu, opcode[1]); 								break;
-		case 0xc7: RST(cpu, mem, 0); 									break;
-		case 0xc8: RZ(cpu, mem); 										break;
-		case 0xc9: RET(cpu, mem); 										break;
-		case 0xca: JZ(cpu, to_double_word(opcode[1], opcode[2])); 		break;
-		case 0xcc: CZ(cpu, mem, to_double_word(opcode[1], opcode[2])); 	break;
-		case 0xcd: CALL(cpu, mem, to_double_word(opcode[1], opcode[2])); break;
-		case 0xce: ACI(cpu, opcode[1]); 								break;
-		case 0xcf: RST(cpu, mem, 1); 									break;
-		case 0xd0: RNC(cpu, mem); 										break;
-		case 0xd1: POP(cpu, mem, 'D'); 									break;
-		case 0xd2: JNC(cpu, to_double_word(opcode[1], opcode[2])); 		break;
-		case 0xd3: OUT(cpu, opcode[1]); 								break;
-		case 0xd4: CNC(cpu, mem, to_double_word(opcode[1], opcode[2])); break;
-		case 0xd5: PUSH(cpu, mem, 'D'); 								break;
-		case 0xd6: SUI(cpu, opcode[1]); 								break;
-		case 0xd7: RST(cpu, mem, 2); 									break;
-		case 0xd8: RC(cpu, mem); 										break;
-		case 0xda: JC(cpu, to_double_word(opcode[1], opcode[2])); 		break;
-		case 0xdb: IN(cpu, opcode[1]); 									break;
-		case 0xdc: CC(cpu, mem, to_double_word(opcode[1], opcode[2])); 	break;
-		case 0xde: SBI(cpu, opcode[1]); 								break;
-		case 0xdf: RST(cpu, mem, 3); 									break;
-		case 0xe0: RPO(cpu, mem); 										break;
-		case 0xe1: POP(cpu, mem, 'H'); 									break;
-		case 0xe2: JPO(cpu, to_double_word(opcode[1], opcode[2])); 		break;
-		case 0xe3: XTHL(cpu, mem); 										break;
-		case 0xe4: CPO(cpu, mem, to_double_word(opcode[1], opcode[2])); break;
-		case 0xe5: PUSH(cpu, mem, 'H'); 								break;
-		case 0xe6: ANI(cpu, opcode[1]); 								break;
-		case 0xe7: RST(cpu, mem, 4); 									break;
-		case 0xe8: RPE(cpu, mem); 										break;
-		case 0xe9: PCHL(cpu); 											break;
-		case 0xea: JPE(cpu, to_double_word(opcode[1], opcode[2])); 		break;
-		case 0xeb: XCHG(cpu); 											break;
-		case 0xec: CPE(cpu, mem, to_double_word(opcode[1], opcode[2])); break;
-		case 0xee: XRI(cpu, opcode[1]); 								break;
-		case 0xef: RST(cpu, mem, 5); 									break;
-		case 0xf0: RP(cpu, mem); 										break;
-		case 0xf1: POP(cpu, mem, 'P'); 									break;
-		case 0xf2: JP(cpu, to_double_word(opcode[1], opcode[2])); 		break;
-		case 0xf3: DI(cpu, interrupts); 								break;
-		case 0xf4: CP(cpu, mem, to_double_word(opcode[1], opcode[2])); 	break;
-		case 0xf5: PUSH(cpu, mem, 'P'); 								break;
-		case 0xf6: ORI(cpu, opcode[1]); 								break;
-		case 0xf7: RST(cpu, mem, 6); 									break;
-		case 0xf8: RM(cpu, mem); 										break;
-		case 0xf9: SPHL(cpu); 											break;
-		case 0xfa: JM(cpu, to_double_word(opcode[1], opcode[2])); 		break;
-		case 0xfb: EI(cpu, interrupts); 								break;
-		case 0xfc: CM(cpu, mem, to_double_word(opcode[1], opcode[2])); 	break;
-		case 0xfe: CPI(cpu, opcode[1]); 								break;
-		case 0xff: RST(cpu, mem, 7); 									break;
-		default: unimplemented(cpu, opcode[0]); 						break;
+static inline uint8_t flag_p(CPU *cpu) {
+	if(cpu->lazy_flags.pending) {
+		return (zspFlags[cpu->lazy_flags.result] & FLAG_P) >> 2;
 	}
+	return (cpu->flags & FLAG_P) >> 2;
+}
 
-	#ifdef CPU_DEBUG
-	printOpcodeInfo(cpu->pc - opLengths[opcode[0]], opcode);
-	printCPU(cpu, mem);
-
-	fgetc(stdin);
-	#endif
+/* cy is never deferred. */
+static inline uint8_t flag_cy(CPU *cpu) {
+	return cpu->flags & FLAG_CY;
+}
 
-	uint8_t cycles_elapsed = opCycles[opcode[0]];
-	if(cycles_elapsed == 255) {
-		fprintf(stderr, "WARNING: the number of cycles has been improperly set for operation %x. Exiting.\n", opcode[0]);
-		exit(1);
+/* Every write to memory goes through here. The ROM cannot be written to, just like on the real board, so code decoded from it never goes stale.
+ * Nothing is mapped past RAM, so writes there are dropped too, rather than run off the end of mem and vram_dirty. Code decoded from RAM is thrown away as soon as it is written over. Writes to VRAM mark their line as changed, so that only changed lines need
+ * to be drawn again. */
+static inline void write_byte(CPU *cpu, uint8_t *mem, uint16_t addr, uint8_t value) {
+	if(addr < ROM_SIZE || addr >= MEMORY_SIZE) {
+		return;
 	}
-
-	if(cycle_override != 255) {
-		cycles_elapsed = cycle_override;
+	mem[addr] = value;
+	if(addr >= VRAM_START_ADDRESS) {
+		cpu->vram_dirty[(addr - VRAM_START_ADDRESS) >> VRAM_LINE_SHIFT] = 1;
+	}
+	if(cpu->block_cache->code_pages[addr >> CODE_PAGE_SHIFT]) {
+		invalidate_code(cpu->block_cache, addr);
 	}
-	
-	return cycles_elapsed;
 }
 
-/* NOP - no operation. CPU does nothing this cycle. -- 4 cycles -- */
-void NOP(CPU *cpu) {}
+/* Operand accessors for the per-operand handlers below. M is the memory location addressed by H and L. */
+#define REG_B cpu->b
+#define REG_C cpu->c
+#define REG_D cpu->d
+#define REG_E cpu->e
+#define REG_H cpu->h
+#define REG_L cpu->l
+#define REG_M mem[to_double_word(cpu->l, cpu->h)]
+#define REG_A cpu->a
+
+#define SET_B(value) (cpu->b = (value))
+#define SET_C(value) (cpu->c = (value))
+#define SET_D(value) (cpu->d = (value))
+#define SET_E(value) (cpu->e = (value))
+#define SET_H(value) (cpu->h = (value))
+#define SET_L(value) (cpu->l = (value))
+#define SET_M(value) write_byte(cpu, mem, to_double_word(cpu->l, cpu->h), (value))
+#define SET_A(value) (cpu->a = (value))
+
+/* The instructions below encode their operand in the opcode itself. Rather than decoding a register name at runtime, each is stamped out
+ * once per operand (MOV_B_C, INR_M, PUSH_PSW...) so that every opcode gets a handler that touches its registers directly. */
 
 /* MVI - move immediate. loads 8-bit value into given register. -- 7 cycles for A-L, 10 cycles for M -- */
-void MVI(CPU *cpu, uint8_t *mem, char reg, uint8_t imm) {
-	uint8_t *r = get_register(cpu, mem, reg);
+#define DEFINE_MVI(reg) \
+static inline void MVI_##reg(CPU *cpu, uint8_t *mem, uint8_t imm) { SET_##reg(imm); }
 
-	*r = imm;
-}
+DEFINE_MVI(B) DEFINE_MVI(C) DEFINE_MVI(D) DEFINE_MVI(E) DEFINE_MVI(H) DEFINE_MVI(L) DEFINE_MVI(M) DEFINE_MVI(A)
 
 /* LXI - load 16-bit immediate. loads high byte into given register, and low byte into neighboring register. -- 10 cycles -- */
-void LXI(CPU *cpu, char reg, uint16_t imm) {
-	uint8_t *low;
-	uint8_t *high;
-
-	switch(reg) {
-		case 'B':
-			low = &cpu->c;
-			high = &cpu->b;
-			break;
-		case 'D':
-			low = &cpu->e;
-			high = &cpu->d;
-			break;
-		case 'H':
-			low = &cpu->l;
-			high = &cpu->h;
-			break;
-		case 'S': /* stack pointer - special handling */
-			cpu->sp = imm;
-			return;
-	}
+#define DEFINE_LXI(pair, high, low) \
+static inline void LXI_##pair(CPU *cpu, uint16_t imm) { from_double_word(imm, &cpu->low, &cpu->high); }
 
-	from_double_word(imm, low, high);
+DEFINE_LXI(B, b, c) DEFINE_LXI(D, d, e) DEFINE_LXI(H, h, l)
+
+static inline void LXI_SP(CPU *cpu, uint16_t imm) {
+	cpu->sp = imm;
 }
 
 /* INR - register increment. Increments the value of the given register by 1. -- 5 cycles for A-L, 10 cycles for M -- */
-void INR(CPU *cpu, uint8_t *mem, char reg) {
-	uint8_t *r = get_register(cpu, mem, reg); /* register is a keyword I guess */
+static inline uint8_t inr(CPU *cpu, uint8_t value) {
+	set_zspac(cpu, value + 1, value, 1);
 
-	*r += 1;
+	return value + 1;
+}
 
-	set_z(&cpu->flags, *r);
-	set_s(&cpu->flags, *r);
-	set_p(&cpu->flags, *r);
+#define DEFINE_INR(reg) \
+static inline void INR_##reg(CPU *cpu, uint8_t *mem) { SET_##reg(inr(cpu, REG_##reg)); }
 
-	/* set ac - special handling */
-	uint8_t ac_check = ((*r - 1) & 0x0f) + 1;
-	if((ac_check & 0x10) == 0x10)
-		cpu->flags.ac = 1;
-	else
-		cpu->flags.ac = 0;
-}
+DEFINE_INR(B) DEFINE_INR(C) DEFINE_INR(D) DEFINE_INR(E) DEFINE_INR(H) DEFINE_INR(L) DEFINE_INR(M) DEFINE_INR(A)
 
 /* DCR - register decrement. Decrements the value of the given register by 1. -- 5 cycle for A-L, 10 cycles for M -- */
-void DCR(CPU *cpu, uint8_t *mem, char reg) {
-	uint8_t *r = get_register(cpu, mem, reg);
+static inline uint8_t dcr(CPU *cpu, uint8_t value) {
+	set_zspac(cpu, value - 1, value, 0x0f); /* set ac - add lower four bits with 2's complement of -1 */
 
-	*r -= 1;
+	return value - 1;
+}
 
-	set_z(&cpu->flags, *r);
-	set_s(&cpu->flags, *r);
-	set_p(&cpu->flags, *r);
+#define DEFINE_DCR(reg) \
+static inline void DCR_##reg(CPU *cpu, uint8_t *mem) { SET_##reg(dcr(cpu, REG_##reg)); }
 
-	/* set ac - add lower four bits with 2's complement of -1 */
-	uint8_t ac_check = ((*r + 1) & 0x0f) + 0x0f;
-	if((ac_check & 0x10) == 0x10)
-		cpu->flags.ac = 1;
-	else
-		cpu->flags.ac = 0;
-}
+DEFINE_DCR(B) DEFINE_DCR(C) DEFINE_DCR(D) DEFINE_DCR(E) DEFINE_DCR(H) DEFINE_DCR(L) DEFINE_DCR(M) DEFINE_DCR(A)
 
 /* INX - register pair increment. Increments the 16-bit value stored in the register pair. Used for advancing memory addresses. Does not set flags. -- 5 cycle -- */
-void INX(CPU *cpu, char reg) {
-	uint8_t *low;
-	uint8_t *high;
-
-	switch(reg) {
-		case 'B':
-			low = &cpu->c;
-			high = &cpu->b;
-			break;
-		case 'D':
-			low = &cpu->e;
-			high = &cpu->d;
-			break;
-		case 'H':
-			low = &cpu->l;
-			high = &cpu->h;
-			break;
-		case 'S': /* stack pointer */
-			cpu->sp += 1;
-			return;
-	}
+#define DEFINE_INX(pair, high, low) \
+static inline void INX_##pair(CPU *cpu) { from_double_word(to_double_word(cpu->low, cpu->high) + 1, &cpu->low, &cpu->high); }
 
-	uint16_t reg_pair = to_double_word(*low, *high);
-	from_double_word(reg_pair + 1, low, high);
+DEFINE_INX(B, b, c) DEFINE_INX(D, d, e) DEFINE_INX(H, h, l)
+
+static inline void INX_SP(CPU *cpu) {
+	cpu->sp += 1;
 }
 
 /* DCX - register pair decrement. Decrements the 16-bit value stored in the register pair. Does not set flags. -- 5 cycles -- */
-void DCX(CPU *cpu, char reg) {
-	uint8_t *low;
-	uint8_t *high;
-
-	switch(reg) {
-		case 'B':
-			low = &cpu->c;
-			high = &cpu->b;
-			break;
-		case 'D':
-			low = &cpu->e;
-			high = &cpu->d;
-			break;
-		case 'H':
-			low = &cpu->l;
-			high = &cpu->h;
-			break;
-		case 'S': /* stack pointer - special handling */
-			cpu->sp -= 1;
-			return;
-	}
+#define DEFINE_DCX(pair, high, low) \
+static inline void DCX_##pair(CPU *cpu) { from_double_word(to_double_word(cpu->low, cpu->high) - 1, &cpu->low, &cpu->high); }
 
-	uint16_t reg_pair = to_double_word(*low, *high);
-	from_double_word(reg_pair - 1, low, high);
+DEFINE_DCX(B, b, c) DEFINE_DCX(D, d, e) DEFINE_DCX(H, h, l)
+
+static inline void DCX_SP(CPU *cpu) {
+	cpu->sp -= 1;
 }
 
 /* DAD - double register add. Adds the 16-bit value stored in the register pair to the 16-bit value stored in the HL pair. The result is stored in HL. -- 10 cycles -- */
-void DAD(CPU *cpu, char reg) {
-	uint16_t reg_pair;
-
-	switch(reg) {
-		case 'B':
-			reg_pair = to_double_word(cpu->c, cpu->b);
-			break;
-		case 'D':
-			reg_pair = to_double_word(cpu->e, cpu->d);
-			break;
-		case 'H':
-			reg_pair = to_double_word(cpu->l, cpu->h);
-			break;
-		case 'S': /* stack pointer */
-			reg_pair = cpu->sp;
-			break;
-	}
-
+static inline void dad(CPU *cpu, uint16_t reg_pair) {
 	uint16_t hl_pair = to_double_word(cpu->l, cpu->h);
 	uint32_t result = reg_pair + hl_pair;
 	from_double_word((uint16_t)result, &cpu->l, &cpu->h);
 
 	/* set carry if overflow */
-	if((result & 0x00010000) == 0x00010000)
-		cpu->flags.cy = 1;
-	else
-		cpu->flags.cy = 0;
+	cpu->flags = (cpu->flags & ~FLAG_CY) | ((result >> 16) & FLAG_CY);
 }
 
-/* ADI - add immediate. adds a given byte to the A register, stores the result in A. -- 7 cycles -- */
-void ADI(CPU *cpu, uint8_t imm) {
-	uint16_t result = cpu->a + imm;
-	set_z(&cpu->flags, result);
-	set_s(&cpu->flags, result);
-	set_p(&cpu->flags, result);
-	set_cy(&cpu->flags, result);
+#define DEFINE_DAD(pair, high, low) \
+static inline void DAD_##pair(CPU *cpu) { dad(cpu, to_double_word(cpu->low, cpu->high)); }
 
-	uint8_t ac_check = (cpu->a & 0x0f) + (imm & 0x0f);
-	if((ac_check & 0x10) == 0x10)
-		cpu->flags.ac = 1;
-	else
-		cpu->flags.ac = 0;
+DEFINE_DAD(B, b, c) DEFINE_DAD(D, d, e) DEFINE_DAD(H, h, l)
 
-	cpu->a = (uint8_t)result;
+static inline void DAD_SP(CPU *cpu) {
+	dad(cpu, cpu->sp);
 }
 
-/* SUI - subtract immediate. subtracts a given byte from the A register, stores the result in A. -- 7 cycles -- */
-void SUI(CPU *cpu, uint8_t imm) {
-	uint16_t result = cpu->a - imm;
-	set_z(&cpu->flags, result);
-	set_s(&cpu->flags, result);
-	set_p(&cpu->flags, result);
-	set_cy(&cpu->flags, result);
+/* MOV - move. copies the contents of the second register into the first. -- 5 cycle for A-L, 7 cycles for M (in either operand) -- */
+#define DEFINE_MOV(dreg, sreg) \
+static inline void MOV_##dreg##_##sreg(CPU *cpu, uint8_t *mem) { SET_##dreg(REG_##sreg); }
+
+DEFINE_MOV(B, B) DEFINE_MOV(B, C) DEFINE_MOV(B, D) DEFINE_MOV(B, E) DEFINE_MOV(B, H) DEFINE_MOV(B, L) DEFINE_MOV(B, M) DEFINE_MOV(B, A)
+DEFINE_MOV(C, B) DEFINE_MOV(C, C) DEFINE_MOV(C, D) DEFINE_MOV(C, E) DEFINE_MOV(C, H) DEFINE_MOV(C, L) DEFINE_MOV(C, M) DEFINE_MOV(C, A)
+DEFINE_MOV(D, B) DEFINE_MOV(D, C) DEFINE_MOV(D, D) DEFINE_MOV(D, E) DEFINE_MOV(D, H) DEFINE_MOV(D, L) DEFINE_MOV(D, M) DEFINE_MOV(D, A)
+DEFINE_MOV(E, B) DEFINE_MOV(E, C) DEFINE_MOV(E, D) DEFINE_MOV(E, E) DEFINE_MOV(E, H) DEFINE_MOV(E, L) DEFINE_MOV(E, M) DEFINE_MOV(E, A)
+DEFINE_MOV(H, B) DEFINE_MOV(H, C) DEFINE_MOV(H, D) DEFINE_MOV(H, E) DEFINE_MOV(H, H) DEFINE_MOV(H, L) DEFINE_MOV(H, M) DEFINE_MOV(H, A)
+DEFINE_MOV(L, B) DEFINE_MOV(L, C) DEFINE_MOV(L, D) DEFINE_MOV(L, E) DEFINE_MOV(L, H) DEFINE_MOV(L, L) DEFINE_MOV(L, M) DEFINE_MOV(L, A)
+DEFINE_MOV(M, B) DEFINE_MOV(M, C) DEFINE_MOV(M, D) DEFINE_MOV(M, E) DEFINE_MOV(M, H) DEFINE_MOV(M, L)                  DEFINE_MOV(M, A)
+DEFINE_MOV(A, B) DEFINE_MOV(A, C) DEFINE_MOV(A, D) DEFINE_MOV(A, E) DEFINE_MOV(A, H) DEFINE_MOV(A, L) DEFINE_MOV(A, M) DEFINE_MOV(A, A)
+
+/* Register forms of the accumulator operations. Each behaves exactly like its immediate counterpart, with the register as the operand. -- 4 cycles for A-L, 7 cycles for M --
+ * ADD - add.                ADC - add with carry.        SUB - subtract.      SBB - subtract with borrow.
+ * ANA - bitwise AND.        XRA - bitwise XOR.           ORA - bitwise OR.    CMP - compare (sets flags as SUB would, but leaves A unchanged).
+ */
+#define DEFINE_ALU(name, immediate_form, reg) \
+static inline void name##_##reg(CPU *cpu, uint8_t *mem) { immediate_form(cpu, REG_##reg); }
+
+#define DEFINE_ALU_FOR_EACH_REGISTER(name, immediate_form)                                                                       \
+	DEFINE_ALU(name, immediate_form, B) DEFINE_ALU(name, immediate_form, C) DEFINE_ALU(name, immediate_form, D)                  \
+	DEFINE_ALU(name, immediate_form, E) DEFINE_ALU(name, immediate_form, H) DEFINE_ALU(name, immediate_form, L)                  \
+	DEFINE_ALU(name, immediate_form, M) DEFINE_ALU(name, immediate_form, A)
+
+DEFINE_ALU_FOR_EACH_REGISTER(ADD, ADI)
+DEFINE_ALU_FOR_EACH_REGISTER(ADC, ACI)
+DEFINE_ALU_FOR_EACH_REGISTER(SUB, SUI)
+DEFINE_ALU_FOR_EACH_REGISTER(SBB, SBI)
+DEFINE_ALU_FOR_EACH_REGISTER(ANA, ANI)
+DEFINE_ALU_FOR_EACH_REGISTER(XRA, XRI)
+DEFINE_ALU_FOR_EACH_REGISTER(ORA, ORI)
+DEFINE_ALU_FOR_EACH_REGISTER(CMP, CPI)
 
-	uint8_t ac_check = (cpu->a & 0x0f) + (two_comp(imm) & 0x0f);
-	if((ac_check & 0x10) == 0x10)
-		cpu->flags.ac = 1;
-	else
-		cpu->flags.ac = 0;
+/* PUSH - push on to stack. pushes the given register pair on to the stack. -- 11 cycles -- */
+#define DEFINE_PUSH(pair, high, low) \
+static inline void PUSH_##pair(CPU *cpu, uint8_t *mem) { stack_push(cpu, mem, cpu->high, cpu->low); }
 
-	cpu->a = (uint8_t)result;
-}
+DEFINE_PUSH(B, b, c) DEFINE_PUSH(D, d, e) DEFINE_PUSH(H, h, l)
 
-/* ACI - add immediate with carry. adds a given byte to the A register, adds the carry bit, and stores the result in A. -- 7 cycles -- */
-void ACI(CPU *cpu, uint8_t imm) {
-	uint16_t result = cpu->a + imm + cpu->flags.cy;
-	set_z(&cpu->flags, result);
-	set_s(&cpu->flags, result);
-	set_p(&cpu->flags, result);
+static inline void PUSH_PSW(CPU *cpu, uint8_t *mem) {
+	materialize_flags(cpu);
+	stack_push(cpu, mem, cpu->a, cpu->flags); /* flags are already laid out as the PSW byte */
+}
 
-	uint8_t ac_check = (cpu->a & 0x0f) + (imm & 0x0f) + cpu->flags.cy;
-	if((ac_check & 0x10) == 0x10)
-		cpu->flags.ac = 1;
-	else
-		cpu->flags.ac = 0;
+/* POP - pop off stack. pops two bytes off the stack into the given register pair. -- 10 cycles -- */
+#define DEFINE_POP(pair, high, low) \
+static inline void POP_##pair(CPU *cpu, uint8_t *mem) { stack_pop(cpu, mem, &cpu->low, &cpu->high); }
 
-	set_cy(&cpu->flags, result);
+DEFINE_POP(B, b, c) DEFINE_POP(D, d, e) DEFINE_POP(H, h, l)
 
-	cpu->a = (uint8_t)result;
+static inline void POP_PSW(CPU *cpu, uint8_t *mem) {
+	uint8_t psw;
+	stack_pop(cpu, mem, &psw, &cpu->a);
+	cpu->flags = (psw & FLAG_MASK) | FLAG_ALWAYS_SET; /* bits 1, 3 and 5 are not real flags, and always read back as 1, 0 and 0 */
+	cpu->lazy_flags.pending = 0;
 }
 
-/* SBI - subtract immediate with borrow. subtracts a given byte from the A register, subtracts the carry bit, and stores the result in A. -- 7 cycles -- */
-void SBI(CPU *cpu, uint8_t imm) {
-	uint16_t result = cpu->a - imm - cpu->flags.cy;
-	set_z(&cpu->flags, result);
-	set_s(&cpu->flags, result);
-	set_p(&cpu->flags, result);
+/* STAX - store accumulator. stores the value in register A into the memory address given by the concatenation of the given register and its neighbor. -- 7 cycles -- */
+#define DEFINE_STAX(pair, high, low) \
+static inline void STAX_##pair(CPU *cpu, uint8_t *mem) { write_byte(cpu, mem, to_double_word(cpu->low, cpu->high), cpu->a); }
 
-	uint8_t ac_check = (cpu->a & 0x0f) + (two_comp(imm + cpu->flags.cy) & 0x0f);
-	if((ac_check & 0x10) == 0x10)
-		cpu->flags.ac = 1;
-	else
-		cpu->flags.ac = 0;
+DEFINE_STAX(B, b, c) DEFINE_STAX(D, d, e)
 
-	set_cy(&cpu->flags, result);
+/* LDAX - load accumulator. Loads the value stored at the memory address given by the register pair into register A. -- 7 cycles -- */
+#define DEFINE_LDAX(pair, high, low) \
+static inline void LDAX_##pair(CPU *cpu, uint8_t *mem) { cpu->a = mem[to_double_word(cpu->low, cpu->high)]; }
+
+DEFINE_LDAX(B, b, c) DEFINE_LDAX(D, d, e)
+
+/* Immediate operands of the instruction being executed, as decoded into its DecodedInstruction. */
+#define IMM8 ((uint8_t)ins->operand)
+#define IMM16 (ins->operand)
+
+/* Whether an instruction can send PC anywhere other than the instruction after it, or stop the CPU. Blocks end with the first one of these. */
+static inline int ends_block(uint8_t op) {
+	switch(op) {
+		case 0xc2: case 0xc3: case 0xca: case 0xd2: case 0xda: case 0xe2: case 0xea: case 0xf2: case 0xfa: /* JMP, Jcc */
+		case 0xc4: case 0xcc: case 0xcd: case 0xd4: case 0xdc: case 0xe4: case 0xec: case 0xf4: case 0xfc: /* CALL, Ccc */
+		case 0xc0: case 0xc8: case 0xc9: case 0xd0: case 0xd8: case 0xe0: case 0xe8: case 0xf0: case 0xf8: /* RET, Rcc */
+		case 0xc7: case 0xcf: case 0xd7: case 0xdf: case 0xe7: case 0xef: case 0xf7: case 0xff: /* RST */
+		case 0xe9: /* PCHL */
+		case 0x76: /* HLT */
+			return 1;
+	}
+	return 0;
+}
+
+/* Whether an instruction writes to memory. Code decoded from RAM stops after one of these, as it may have just overwritten the rest of it. */
+static inline int writes_memory(uint8_t op) {
+	switch(op) {
+		case 0x02: case 0x12: /* STAX */
+		case 0x22: case 0x32: /* SHLD, STA */
+		case 0x34: case 0x35: case 0x36: /* INR M, DCR M, MVI M */
+		case 0x70: case 0x71: case 0x72: case 0x73: case 0x74: case 0x75: case 0x77: /* MOV M,r */
+		case 0xc5: case 0xd5: case 0xe5: case 0xf5: case 0xe3: /* PUSH, XTHL */
+			return 1;
+	}
+	return 0;
+}
+
+static inline void decode_instruction(DecodedInstruction *ins, uint8_t *bytes, uint16_t next_pc, const void **handlers) {
+	ins->handler = handlers != NULL ? handlers[bytes[0]] : NULL;
+	ins->next_pc = next_pc;
+	ins->op = bytes[0];
+	ins->cycles = opCycles[bytes[0]];
+	switch(opLengths[bytes[0]]) {
+		case 3: ins->operand = to_double_word(bytes[1], bytes[2]); break;
+		case 2: ins->operand = bytes[1]; break;
+		default: ins->operand = 0; break;
+	}
+}
+
+#ifdef CPU_FUSED_LOOPS_ENABLED
+/* Fused loops. Space Invaders spends a good part of every frame in a handful of tight loops that copy, draw or clear memory a byte at a time.
+ * Each of them is a single block that ends by jumping back to its own start, so once its block is recognised below, whole iterations can be
+ * run back to back in C, with no dispatching, budget checks or block lookups in between. Every instruction still goes through the same
+ * handler, so registers, flags, memory and cycles end up exactly as if they had been run one by one. */
+typedef enum {
+	FUSED_NONE = 0,
+	FUSED_COPY,            /* LDAX D / MOV M,A / INX H / INX D / DCR B / JNZ - copies B bytes from DE to HL */
+	FUSED_CLEAR_ROW,       /* XRA A / MOV M,A / INX H / DCR C / JNZ - clears C bytes from HL */
+	FUSED_FILL_TO_PAGE,    /* MVI M,n / INX H / MOV A,H / CPI p / JNZ - fills from HL up to page p, as clearing the screen does */
+	FUSED_DRAW_COLUMN,     /* PUSH B / LDAX D / MOV M,A / INX D / LXI B,n / DAD B / POP B / DCR B / JNZ - copies B bytes from DE to every nth byte from HL */
+	FUSED_CLEAR_COLUMN,    /* PUSH B / MOV M,A / LXI B,n / DAD B / POP B / DCR B / JNZ - stores A to every nth of B bytes from HL */
+	NUM_OF_FUSED_LOOPS
+} FusedLoop;
+
+/* The opcodes of each loop's block, JNZ included. Immediate operands may be anything, and are read from the decoded instructions. */
+static const uint8_t fused_loop_ops[NUM_OF_FUSED_LOOPS][BLOCK_MAX_INSTRUCTIONS] = {
+	[FUSED_COPY]         = { 0x1a, 0x77, 0x23, 0x13, 0x05, 0xc2 },
+	[FUSED_CLEAR_ROW]    = { 0xaf, 0x77, 0x23, 0x0d, 0xc2 },
+	[FUSED_FILL_TO_PAGE] = { 0x36, 0x23, 0x7c, 0xfe, 0xc2 },
+	[FUSED_DRAW_COLUMN]  = { 0xc5, 0x1a, 0x77, 0x13, 0x01, 0x09, 0xc1, 0x05, 0xc2 },
+	[FUSED_CLEAR_COLUMN] = { 0xc5, 0x77, 0x01, 0x09, 0xc1, 0x05, 0xc2 },
+};
+static const uint8_t fused_loop_lengths[NUM_OF_FUSED_LOOPS] = {
+	[FUSED_COPY] = 6, [FUSED_CLEAR_ROW] = 5, [FUSED_FILL_TO_PAGE] = 5, [FUSED_DRAW_COLUMN] = 9, [FUSED_CLEAR_COLUMN] = 7,
+};
+
+/* Works out which fused loop, if any, a freshly decoded block is one iteration of. Blocks in RAM are left alone, as they could write over
+ * themselves partway through. */
+static uint8_t match_fused_loop(const Block *block) {
+	const DecodedInstruction *last = &block->instructions[block->length - 1];
+	if(block->in_ram || last->op != 0xc2 || last->operand != block->start) {
+		return FUSED_NONE;
+	}
+
+	uint8_t loop;
+	for(loop = FUSED_NONE + 1; loop < NUM_OF_FUSED_LOOPS; ++loop) {
+		if(block->length != fused_loop_lengths[loop]) {
+			continue;
+		}
+		int i = 0;
+		while(i < block->length && block->instructions[i].op == fused_loop_ops[loop][i]) {
+			++i;
+		}
+		if(i == block->length) {
+			return loop;
+		}
+	}
+	return FUSED_NONE;
+}
+
+/* Runs whole iterations of a fused loop, starting at PC, for as long as each one would jump back to the start and fit in the remaining cycles.
+ * The last iteration, and any the budget cuts short, are left to the interpreter. Returns the number of cycles run. */
+static unsigned long run_fused_loop(CPU *cpu, uint8_t *mem, const Block *block, unsigned long remaining) {
+	const DecodedInstruction *ins = block->instructions;
+	unsigned long taken = 0;
+
+	/* JNZ loops back unless the instruction before it left a zero, which each condition below predicts before the iteration runs */
+	switch(block->fused) {
+		case FUSED_COPY:
+			for(; cpu->b != 1 && taken + block->cycles < remaining; taken += block->cycles) {
+				LDAX_D(cpu, mem);
+				MOV_M_A(cpu, mem);
+				INX_H(cpu);
+				INX_D(cpu);
+				DCR_B(cpu, mem);
+			}
+			break;
+		case FUSED_CLEAR_ROW:
+			for(; cpu->c != 1 && taken + block->cycles < remaining; taken += block->cycles) {
+				XRA_A(cpu, mem);
+				MOV_M_A(cpu, mem);
+				INX_H(cpu);
+				DCR_C(cpu, mem);
+			}
+			break;
+		case FUSED_FILL_TO_PAGE:
+			for(; (uint8_t)((to_double_word(cpu->l, cpu->h) + 1) >> 8) != (uint8_t)ins[3].operand && taken + block->cycles < remaining; taken += block->cycles) {
+				MVI_M(cpu, mem, ins[0].operand);
+				INX_H(cpu);
+				MOV_A_H(cpu, mem);
+				CPI(cpu, ins[3].operand);
+			}
+			break;
+		case FUSED_DRAW_COLUMN:
+			for(; cpu->b != 1 && taken + block->cycles < remaining; taken += block->cycles) {
+				PUSH_B(cpu, mem);
+				LDAX_D(cpu, mem);
+				MOV_M_A(cpu, mem);
+				INX_D(cpu);
+				LXI_B(cpu, ins[4].operand);
+				DAD_B(cpu);
+				POP_B(cpu, mem);
+				DCR_B(cpu, mem);
+			}
+			break;
+		case FUSED_CLEAR_COLUMN:
+			for(; cpu->b != 1 && taken + block->cycles < remaining; taken += block->cycles) {
+				PUSH_B(cpu, mem);
+				MOV_M_A(cpu, mem);
+				LXI_B(cpu, ins[2].operand);
+				DAD_B(cpu);
+				POP_B(cpu, mem);
+				DCR_B(cpu, mem);
+			}
+			break;
+	}
 
-	cpu->a = (uint8_t)result;
+	return taken;
 }
+#endif
 
-/* CPI - compare immediate. compares the given byte with register A, sets the zero and carry flags to indicate the result. -- 7 cycles -- */
-void CPI(CPU *cpu, uint8_t imm) {
-	/* this is implemented internally by subtracting the given byte from A, and so it sets all flags. this looks the same as the implementation for SBI, but without setting A. */
-	uint16_t result = cpu->a - imm;
-	set_z(&cpu->flags, result);
-	set_s(&cpu->flags, result);
-	set_p(&cpu->flags, result);
-	set_cy(&cpu->flags, result);
+#ifdef CPU_IDLE_SKIP_ENABLED
+/* Idle loops. Between interrupts the game waits in loops that do nothing but read a flag in RAM which only the interrupt handlers change.
+ * If an iteration of such a loop leaves every register and flag just as it found them, then so will every iteration after it, as nothing
+ * else can write to memory before the next interrupt. Interrupts are only delivered between batches, so the rest of the batch can be skipped. */
+/* Whether a freshly decoded block can only ever affect registers and flags, and ends by jumping back to its own start. */
+static uint8_t may_idle(const Block *block) {
+	const DecodedInstruction *last = &block->instructions[block->length - 1];
+	if(last->operand != block->start || !(last->op == 0xc3 || (last->op & 0xc7) == 0xc2)) { /* JMP or Jcc */
+		return 0;
+	}
 
-	/* set ac */
-	uint8_t ac_check = (cpu->a & 0x0f) + (two_comp(imm) & 0x0f);
-	if((ac_check & 0x10) == 0x10)
-		cpu->flags.ac = 1;
-	else
-		cpu->flags.ac = 0;
-}
+	int i;
+	for(i = 0; i < block->length - 1; ++i) {
+		uint8_t op = block->instructions[i].op;
+		if(writes_memory(op) || op == 0xdb || op == 0xd3 || op == 0xfb || op == 0xf3 || op == 0xc1 || op == 0xd1 || op == 0xe1 || op == 0xf1) {
+			return 0; /* stores, IN, OUT, EI, DI and POP. anything that ends a block can only come last */
+		}
+	}
+	return 1;
+}
+
+/* Called as each block is entered. Returns 1 if the block is an idle loop, having just gone round once without changing anything. */
+static inline int is_idling(CPU *cpu, const Block *block) {
+	IdleWatch *idle_watch = &cpu->block_cache->idle_watch;
+	if(!block->may_idle) {
+		idle_watch->block = NULL;
+		return 0;
+	}
+
+	materialize_flags(cpu);
+	uint8_t registers[7] = { cpu->b, cpu->c, cpu->d, cpu->e, cpu->h, cpu->l, cpu->a };
+	if(idle_watch->block == block && idle_watch->sp == cpu->sp && idle_watch->flags == cpu->flags && memcmp(idle_watch->registers, registers, 7) == 0) {
+		return 1;
+	}
+
+	idle_watch->block = block;
+	memcpy(idle_watch->registers, registers, 7);
+	idle_watch->sp = cpu->sp;
+	idle_watch->flags = cpu->flags;
+	return 0;
+}
+#endif
+
+/* Decodes the basic block starting at PC, and adds it to the cache. */
+static Block *decode_block(CPU *cpu, uint8_t *mem, const void **handlers) {
+	Block *block = allocate_block(cpu->block_cache, cpu->pc);
+	uint16_t pc = cpu->pc;
+	int in_ram = 0;
+
+	while(1) {
+		uint8_t op = mem[pc];
+		uint8_t length = opLengths[op];
+		if(block->length > 0 && pc + length > MEMORY_SIZE) {
+			break; /* never decode past the end of memory. should PC really get there, that instruction gets a block of its own */
+		}
+
+		decode_instruction(&block->instructions[block->length++], &mem[pc], pc + length, handlers);
+		block->cycles += opCycles[op];
+		block->bytes += length;
+		if(pc + length > ROM_SIZE) {
+			in_ram = 1;
+		}
+		pc += length;
+
+		if(ends_block(op) || (in_ram && writes_memory(op)) || block->length == BLOCK_MAX_INSTRUCTIONS) {
+			break;
+		}
+		if(block->start < ROM_SIZE && pc >= ROM_SIZE) {
+			break; /* keep blocks in ROM from running on into RAM, so they never need to be invalidated */
+		}
+	}
 
-/* ANI - and immediate. takes the bitwise and of register A and a given byte, stores the result in A. -- 7 cycles -- */
-void ANI(CPU *cpu, uint8_t imm) {
-	cpu->a = cpu->a & imm;
-	set_z(&cpu->flags, cpu->a);
-	set_s(&cpu->flags, cpu->a);
-	set_p(&cpu->flags, cpu->a);
-	cpu->flags.cy = 0;
-	cpu->flags.ac = 0;
+	finish_block(cpu->block_cache, block, in_ram);
+	#ifdef CPU_FUSED_LOOPS_ENABLED
+	block->fused = match_fused_loop(block);
+	#endif
+	#ifdef CPU_IDLE_SKIP_ENABLED
+	block->may_idle = may_idle(block);
+	#endif
+	return block;
 }
 
-/* ORI - or immediate. takes the bitwise or of register A and a given byte, stores the result in A. -- 7 cycles -- */
-void ORI(CPU *cpu, uint8_t imm) {
-	cpu->a = cpu->a | imm;
-	set_z(&cpu->flags, cpu->a);
-	set_s(&cpu->flags, cpu->a);
-	set_p(&cpu->flags, cpu->a);
-	cpu->flags.cy = 0;
-	cpu->flags.ac = 0;
+/* Finds the block at PC, decoding it first if needed, and works out how much of it to run: all of it if the budget allows, or else just the
+ * instructions that running one at a time until the budget ran out would have reached. Their cycles are added to *cycles up front, and *end is
+ * set past the last of them. Only the last instruction of a block can take fewer cycles than opCycles says (a conditional call or return
+ * that is not taken), so the sum is exact until TIMED() corrects it.
+ * Returns the first instruction left to interpret. With the JIT, that is past any that were just run as native code, and may be *end. */
+static inline const DecodedInstruction *enter_block(CPU *cpu, uint8_t *mem, const void **handlers, unsigned long remaining, const DecodedInstruction **end, unsigned long *cycles) {
+	Block *block = find_block(cpu->block_cache, cpu->pc);
+	if(block == NULL) {
+		block = decode_block(cpu, mem, handlers);
+	}
+
+	#ifdef CPU_IDLE_SKIP_ENABLED
+	if(is_idling(cpu, block)) {
+		/* skip as many whole iterations as fit, which leave everything as it is now. a partial one may still run below */
+		unsigned long skipped = remaining - remaining % block->cycles;
+		*cycles += skipped;
+		remaining -= skipped;
+	}
+	#endif
+
+	#ifdef CPU_FUSED_LOOPS_ENABLED
+	if(block->fused != FUSED_NONE) {
+		unsigned long taken = run_fused_loop(cpu, mem, block, remaining);
+		*cycles += taken;
+		remaining -= taken; /* then the final iteration runs like any other block */
+	}
+	#endif
+
+	if(block->cycles <= remaining) {
+		*end = block->instructions + block->length;
+		*cycles += block->cycles;
+
+		#ifdef CPU_JIT_ENABLED
+		/* only ROM code is translated, so translated code never needs throwing away. partial runs and interrupts stay interpreted */
+		if(block->native == NULL && !block->in_ram && ++block->runs == JIT_THRESHOLD) {
+			jit_compile(cpu->block_cache, block);
+		}
+		if(block->native != NULL) {
+			block->native(cpu, mem);
+			return block->instructions + block->native_length;
+		}
+		#endif
+	}
+	else {
+		const DecodedInstruction *ins = block->instructions;
+		unsigned long taken = 0;
+		while(taken < remaining) {
+			taken += ins->cycles;
+			++ins;
+		}
+		*end = ins;
+		*cycles += taken;
+	}
+
+	return block->instructions;
 }
 
+/* Decodes the instruction an interrupt has placed on the bus. It runs in place of the next instruction in memory, so PC stays where it is. */
+static inline const DecodedInstruction *take_interrupt(CPU *cpu, DecodedInstruction *interrupt, const void **handlers) {
+	decode_instruction(interrupt, &cpu->interrupt_instruction[0], cpu->pc, handlers);
+	cpu->has_interrupt = 0;
+	return interrupt;
+}
+
+/* The address ins was decoded from, and its bytes as they were when it was decoded. */
+#define INSTRUCTION_ADDRESS() (ins == &interrupt ? cpu->pc : (uint16_t)(ins->next_pc - opLengths[ins->op]))
+#define INSTRUCTION_BYTES { ins->op, ins->operand & 0xff, ins->operand >> 8 }
+
+#ifdef CPU_PRINT
+#define PRINT_INSTRUCTION()                                                            \
+do {                                                                                   \
+	uint8_t instruction_bytes[3] = INSTRUCTION_BYTES;                                  \
+	char disassembled[32];                                                             \
+	disassemble(instruction_bytes, disassembled);                                      \
+	if(ins == &interrupt) {                                                            \
+		fprintf(stdout, "Interrupt! %s\n", disassembled);                              \
+	}                                                                                  \
+	else {                                                                             \
+		fprintf(stdout, "0x%.4x: %s\n", INSTRUCTION_ADDRESS(), disassembled);          \
+	}                                                                                  \
+} while(0)
+#else
+#define PRINT_INSTRUCTION()
+#endif
+
+#ifdef CPU_DEBUG
+#define DEBUG_INSTRUCTION()                                   \
+do {                                                          \
+	uint8_t instruction_bytes[3] = INSTRUCTION_BYTES;         \
+	printOpcodeInfo(INSTRUCTION_ADDRESS(), instruction_bytes);\
+	printCPU(cpu, mem);                                       \
+	fgetc(stdin);                                             \
+} while(0)
+#else
+#define DEBUG_INSTRUCTION()
+#endif
+
+/* Counts the exact cycles of a conditional call or return. opCycles, and so the cycles added when its block was entered, assumed it was taken. */
+#define TIMED(exact) (cycles += (exact) - ins->cycles)
+#define FIXED(statement) statement /* already counted when the block was entered */
+
+#ifdef CPU_THREADED_DISPATCH
+/* Direct-threaded core. Every handler ends by jumping straight to the handler of the next decoded instruction, so each opcode gets its own
+ * indirect branch (and its own slot in the branch predictor) instead of all of them sharing the single jump of a switch. */
+static unsigned long execute(CPU *cpu, uint8_t *mem, Interrupt *interrupts, unsigned long budget) {
+	static const void *dispatch_table[NUM_OF_OPCODES] = {
+		[0 ... NUM_OF_OPCODES - 1] = &&op_unimplemented,
+		#define OP(code, ...) [code] = &&op_##code,
+		#include "cpu8080_ops.h"
+	};
+
+	unsigned long cycles = 0;
+	const DecodedInstruction *ins;
+	const DecodedInstruction *block_end;
+	DecodedInstruction interrupt;
+
+	#define RUN()                                         \
+	do {                                                  \
+		cpu->pc = ins->next_pc;                           \
+		PRINT_INSTRUCTION();                              \
+		goto *ins->handler;                               \
+	} while(0)
+
+	#define DISPATCH()                                    \
+	do {                                                  \
+		if(++ins == block_end) {                          \
+			goto next_block;                              \
+		}                                                 \
+		RUN();                                            \
+	} while(0)
+
+	#ifdef CPU_IDLE_SKIP_ENABLED
+	cpu->block_cache->idle_watch.block = NULL; /* an interrupt may be about to change what the loop reads */
+	#endif
 
-/* XRI - xor immediate. takes the bitwise xor of register A and a given byte, stores the result in A. -- 7 cycles -- */
-void XRI(CPU *cpu, uint8_t imm) {
-	cpu->a = cpu->a ^ imm;
-	set_z(&cpu->flags, cpu->a);
-	set_s(&cpu->flags, cpu->a);
-	set_p(&cpu->flags, cpu->a);
-	cpu->flags.cy = 0;
-	cpu->flags.ac = 0;
+	if(cpu->has_interrupt) {
+		ins = take_interrupt(cpu, &interrupt, dispatch_table);
+		block_end = ins + 1;
+		cycles += ins->cycles;
+		RUN();
+	}
+
+next_block:
+	if(cycles >= budget || cpu->halted) {
+		return cycles;
+	}
+	ins = enter_block(cpu, mem, dispatch_table, budget - cycles, &block_end, &cycles);
+	if(ins == block_end) {
+		goto next_block; /* all of it ran as native code */
+	}
+	RUN();
+
+	#define OP(code, timing, ...) op_##code: timing(__VA_ARGS__); DEBUG_INSTRUCTION(); DISPATCH();
+	#include "cpu8080_ops.h"
+
+op_unimplemented:
+	unimplemented(cpu, ins->op);
+	return cycles;
+
+	#undef DISPATCH
+	#undef RUN
 }
+#else
+/* Portable switch core, used with compilers that do not support computed goto. */
+static unsigned long execute(CPU *cpu, uint8_t *mem, Interrupt *interrupts, unsigned long budget) {
+	unsigned long cycles = 0;
+	const DecodedInstruction *ins = NULL;
+	const DecodedInstruction *block_end = NULL;
+	DecodedInstruction interrupt;
 
-/* MOV - move. copies the contents of the second register into the first. -- 5 cycle for A-L, 7 cycles for M (in either operand) -- */
-void MOV(CPU *cpu, uint8_t *mem, char dreg, char sreg) {
-	uint8_t *source = get_register(cpu, mem, sreg);
-	uint8_t *dest = get_register(cpu, mem, dreg);
+	#ifdef CPU_IDLE_SKIP_ENABLED
+	cpu->block_cache->idle_watch.block = NULL; /* an interrupt may be about to change what the loop reads */
+	#endif
 
-	*dest = *source;
+	if(cpu->has_interrupt) {
+		ins = take_interrupt(cpu, &interrupt, NULL);
+		block_end = ins + 1;
+		cycles += ins->cycles;
+	}
+
+	while(1) {
+		for(; ins != block_end; ++ins) {
+			cpu->pc = ins->next_pc;
+			PRINT_INSTRUCTION();
+
+			switch(ins->op) {
+				#define OP(code, timing, ...) case code: timing(__VA_ARGS__); break;
+				#include "cpu8080_ops.h"
+				default: unimplemented(cpu, ins->op); break;
+			}
+
+			DEBUG_INSTRUCTION();
+		}
+
+		if(cycles >= budget || cpu->halted) {
+			return cycles;
+		}
+		ins = enter_block(cpu, mem, NULL, budget - cycles, &block_end, &cycles);
+	}
 }
+#endif
 
-/* ADD - add. adds the value in the given register to the value in register A, stores the result in A. -- 4 cycles for A-L, 7 cycles for M -- */
-void ADD(CPU *cpu, uint8_t *mem, char reg) {
-	uint8_t *r = get_register(cpu, mem, reg);
+uint8_t emulate(CPU *cpu, uint8_t *mem, Interrupt *interrupts) {
 
-	uint16_t result = cpu->a + *r;
-	set_z(&cpu->flags, result);
-	set_s(&cpu->flags, result);
-	set_p(&cpu->flags, result);
-	set_cy(&cpu->flags, result);
+	if(cpu->halted) {
+		return 0; /* nothing runs until an interrupt restarts the CPU. run_cycles() is what passes the time until then */
+	}
 
-	/* set ac */
-	uint8_t ac_check = (cpu->a & 0x0f) + (*r & 0x0f);
-	if((ac_check & 0x10) == 0x10)
-		cpu->flags.ac = 1;
-	else
-		cpu->flags.ac = 0;
-	
-	cpu->a = (uint8_t)result;
+	return (uint8_t)execute(cpu, mem, interrupts, 1); /* a budget of one cycle runs exactly one instruction */
 }
 
-/* SUB - subtract. subtracts the value in the given register from the value in register A, and stores the result in A. -- 4 cycles for A-L, 7 cycles for M -- */
-void SUB(CPU *cpu, uint8_t *mem, char reg) {
-	uint8_t *r = get_register(cpu, mem, reg);
+#undef FIXED
+#undef TIMED
 
-	uint16_t result = cpu->a - *r;
-	set_z(&cpu->flags, result);
-	set_s(&cpu->flags, result);
-	set_p(&cpu->flags, result);
-	set_cy(&cpu->flags, result);
+#ifdef CPU_RECOMPILED
+/* Defines execute_recompiled(), which takes the same arguments as execute() and calls the same handlers, as statements of its own. */
+#include "recompiled_rom.c"
+#endif
 
-	/* set ac */
-	uint8_t ac_check = (cpu->a & 0x0f) + (two_comp(*r) & 0x0f);
-	if((ac_check & 0x10) == 0x10)
-		cpu->flags.ac = 1;
-	else
-		cpu->flags.ac = 0;
+unsigned long run_cycles(CPU *cpu, uint8_t *mem, Interrupt *interrupts, unsigned long budget) {
+	unsigned long cycles = 0;
 
-	cpu->a = (uint8_t)result;
-}
+	if(!cpu->halted) {
+		#ifdef CPU_RECOMPILED
+		cycles = execute_recompiled(cpu, mem, interrupts, budget);
+		#else
+		cycles = execute(cpu, mem, interrupts, budget);
+		#endif
+	}
 
-/* ADC - add with carry. adds the value in the given register to the value in register A, adds 1 if carry is set, and stores the result in A. -- 4 cycles for A-L, 7 cycles for M -- */
-void ADC(CPU *cpu, uint8_t *mem, char reg) {
-	uint8_t *r = get_register(cpu, mem, reg);
+	if(cpu->halted && cycles < budget) {
+		cycles = budget; /* a halted CPU sits idle until an interrupt arrives, and those are only delivered between batches */
+	}
 
-	uint16_t result = cpu->a + *r + cpu->flags.cy;
-	set_z(&cpu->flags, result);
-	set_s(&cpu->flags, result);
-	set_p(&cpu->flags, result);
+	return cycles;
+}
 
-	uint8_t ac_check = (cpu->a & 0x0f) + (*r & 0x0f) + cpu->flags.cy;
-	if((ac_check & 0x10) == 0x10)
-		cpu->flags.ac = 1;
-	else
-		cpu->flags.ac = 0;
+/* NOP - no operation. CPU does nothing this cycle. -- 4 cycles -- */
+void NOP(CPU *cpu) {}
 
+/* ADI - add immediate. adds a given byte to the A register, stores the result in A. -- 7 cycles -- */
+void ADI(CPU *cpu, uint8_t imm) {
+	uint16_t result = cpu->a + imm;
+	set_zspac(cpu, result, cpu->a, imm & 0x0f);
 	set_cy(&cpu->flags, result);
 
 	cpu->a = (uint8_t)result;
 }
 
-/* SBB - subtract with borrow. subtracts the value in the given register to the value in register A, subtracts 1 if carry is set, and stores the result in A. -- 4 cycles for A-L, 7 cycles for M -- */
-void SBB(CPU *cpu, uint8_t *mem, char reg) {
-	uint8_t *r = get_register(cpu, mem, reg);
-
-	uint16_t result = cpu->a - *r - cpu->flags.cy;
-	set_z(&cpu->flags, result);
-	set_s(&cpu->flags, result);
-	set_p(&cpu->flags, result);
+/* SUI - subtract immediate. subtracts a given byte from the A register, stores the result in A. -- 7 cycles -- */
+void SUI(CPU *cpu, uint8_t imm) {
+	uint16_t result = cpu->a - imm;
+	set_zspac(cpu, result, cpu->a, two_comp(imm) & 0x0f);
+	set_cy(&cpu->flags, result);
 
-	uint8_t ac_check = (cpu->a & 0x0f) + (two_comp(*r + cpu->flags.cy) & 0x0f);
-	if((ac_check & 0x10) == 0x10)
-		cpu->flags.ac = 1;
-	else
-		cpu->flags.ac = 0;
+	cpu->a = (uint8_t)result;
+}
 
+/* ACI - add immediate with carry. adds a given byte to the A register, adds the carry bit, and stores the result in A. -- 7 cycles -- */
+void ACI(CPU *cpu, uint8_t imm) {
+	uint16_t result = cpu->a + imm + flag_cy(cpu);
+	set_zspac(cpu, result, cpu->a, (imm & 0x0f) + flag_cy(cpu));
 	set_cy(&cpu->flags, result);
 
 	cpu->a = (uint8_t)result;
 }
 
-/* CMP - compare. compares the given register with register A, and sets the zero and carry flags to indicate the result. -- 4 cycles for A-L, 7 cycles for M -- */
-void CMP(CPU *cpu, uint8_t *mem, char reg) {
-	uint8_t *r = get_register(cpu, mem, reg);
-
-	/* this is implemented internally by subtracting the given register from A, and so it sets all flags. this looks the same as the implementation for SUB, but without setting A. */
-	uint16_t result = cpu->a - *r;
-	set_z(&cpu->flags, result);
-	set_s(&cpu->flags, result);
-	set_p(&cpu->flags, result);
+/* SBI - subtract immediate with borrow. subtracts a given byte from the A register, subtracts the carry bit, and stores the result in A. -- 7 cycles -- */
+void SBI(CPU *cpu, uint8_t imm) {
+	uint16_t result = cpu->a - imm - flag_cy(cpu);
+	set_zspac(cpu, result, cpu->a, two_comp(imm + flag_cy(cpu)) & 0x0f);
 	set_cy(&cpu->flags, result);
 
-	/* set ac */
-	uint8_t ac_check = (cpu->a & 0x0f) + (two_comp(*r) & 0x0f);
-	if((ac_check & 0x10) == 0x10)
-		cpu->flags.ac = 1;
-	else
-		cpu->flags.ac = 0;
+	cpu->a = (uint8_t)result;
 }
 
-/* ANA - bitwise AND. takes the bitwise AND of the given register and register A, stores the result in register A. -- 4 cycles for A-L, 7 cycles for M -- */
-void ANA(CPU *cpu, uint8_t *mem, char reg) {
-	uint8_t *r = get_register(cpu, mem, reg);
-
-	cpu->a = cpu->a & *r;
-	set_z(&cpu->flags, cpu->a);
-	set_s(&cpu->flags, cpu->a);
-	set_p(&cpu->flags, cpu->a);
-	cpu->flags.cy = 0;
-	cpu->flags.ac = 0;
+/* CPI - compare immediate. compares the given byte with register A, sets the zero and carry flags to indicate the result. -- 7 cycles -- */
+void CPI(CPU *cpu, uint8_t imm) {
+	/* this is implemented internally by subtracting the given byte from A, and so it sets all flags. this looks the same as the implementation for SBI, but without setting A. */
+	uint16_t result = cpu->a - imm;
+	set_zspac(cpu, result, cpu->a, two_comp(imm) & 0x0f);
+	set_cy(&cpu->flags, result);
 }
 
-/* ORA - bitwise OR. takes the bitwise OR of the given register and register A, stores the result in register A. -- 4 cycles for A-L, 7 cycles for M -- */
-void ORA(CPU *cpu, uint8_t *mem, char reg) {
-	uint8_t *r = get_register(cpu, mem, reg);
+/* ANI - and immediate. takes the bitwise and of register A and a given byte, stores the result in A. -- 7 cycles -- */
+void ANI(CPU *cpu, uint8_t imm) {
+	cpu->a = cpu->a & imm;
+	set_zspac(cpu, cpu->a, 0, 0);
+	cpu->flags &= ~FLAG_CY;
+}
 
-	cpu->a = cpu->a | *r;
-	set_z(&cpu->flags, cpu->a);
-	set_s(&cpu->flags, cpu->a);
-	set_p(&cpu->flags, cpu->a);
-	cpu->flags.cy = 0;
-	cpu->flags.ac = 0;
+/* ORI - or immediate. takes the bitwise or of register A and a given byte, stores the result in A. -- 7 cycles -- */
+void ORI(CPU *cpu, uint8_t imm) {
+	cpu->a = cpu->a | imm;
+	set_zspac(cpu, cpu->a, 0, 0);
+	cpu->flags &= ~FLAG_CY;
 }
 
-/* XRA - bitwise XOR. takes the bitwise XOR of the given register and register A, stores the result in register A. -- 4 cycles for A-L, 7 cycles for M -- */
-void XRA(CPU *cpu, uint8_t *mem, char reg) {
-	uint8_t *r = get_register(cpu, mem, reg);
 
-	cpu->a = cpu-> a ^ *r;
-	set_z(&cpu->flags, cpu->a);
-	set_s(&cpu->flags, cpu->a);
-	set_p(&cpu->flags, cpu->a);
-	cpu->flags.cy = 0;
-	cpu->flags.ac = 0;
+/* XRI - xor immediate. takes the bitwise xor of register A and a given byte, stores the result in A. -- 7 cycles -- */
+void XRI(CPU *cpu, uint8_t imm) {
+	cpu->a = cpu->a ^ imm;
+	set_zspac(cpu, cpu->a, 0, 0);
+	cpu->flags &= ~FLAG_CY;
 }
 
 /* CMA - accumulator complement. register A becomes the bitwise negation of A. -- 4 cycles -- */
@@ -812,94 +919,34 @@ void CMA(CPU *cpu) {
 /* RLC - left shift (rotate) with carry. left shift on register A with bit wrapping. -- 4 cycles -- */
 void RLC(CPU *cpu) {
 	uint8_t high_bit = (cpu->a & 0x80) >> 7;
-	cpu->flags.cy = high_bit;
+	cpu->flags = (cpu->flags & ~FLAG_CY) | high_bit;
 	cpu->a = (cpu->a << 1) | high_bit;
 }
 
 /* RRC - right shift (rotate) with carry. right shift on register A with bit wrapping. -- 4 cycles -- */
 void RRC(CPU *cpu) {
 	uint8_t low_bit = (cpu->a & 0x01);
-	cpu->flags.cy = low_bit;
+	cpu->flags = (cpu->flags & ~FLAG_CY) | low_bit;
 	cpu->a = (cpu->a >> 1) | (low_bit << 7);
 }
 
 /* RAL - left shift (rotate) through carry. treats carry as a 9th (high) bit of the accumulator. -- 4 cycles -- */
 void RAL(CPU *cpu) {
 	uint8_t high_bit = (cpu->a & 0x80) >> 7;
-	cpu->a = (cpu->a << 1) | cpu->flags.cy;
-	cpu->flags.cy = high_bit;
+	cpu->a = (cpu->a << 1) | flag_cy(cpu);
+	cpu->flags = (cpu->flags & ~FLAG_CY) | high_bit;
 }
 
 /* RAR - right shift (rotate) through carry. treats carry as a 9th (low) bit of the accumulator. -- 4 cycles -- */
 void RAR(CPU *cpu) {
 	uint8_t low_bit = (cpu->a & 0x01);
-	cpu->a = (cpu->a >> 1) | (cpu->flags.cy << 7);
-	cpu->flags.cy = low_bit;
-}
-
-/* PUSH - push on to stack. pushes the given register pair on to the stack. -- 11 cycles -- */
-void PUSH(CPU *cpu, uint8_t *mem, char reg) {
-	uint8_t low;
-	uint8_t high;
-
-	switch(reg) {
-		case 'B':
-			low = cpu->c;
-			high = cpu->b;
-			break;
-		case 'D':
-			low = cpu->e;
-			high = cpu->d;
-			break;
-		case 'H':
-			low = cpu->l;
-			high = cpu->h;
-			break;
-		case 'P': /* Program Status Word - special handling. low = PSW, since you can't declare new variables in a switch statement */
-			low = 0x02 | (cpu->flags.s << 7) | (cpu->flags.z << 6) | (cpu->flags.ac << 4) | (cpu->flags.p << 2) | cpu->flags.cy; /* starts with 0x02, because the second bit is always set */
-			high = cpu->a;
-			break;
-	}
-
-	stack_push(cpu, mem, high, low);
-}
-
-/* POP - pop off stack. pops two bytes off the stack into the given register pair. -- 10 cycles -- */
-void POP(CPU *cpu, uint8_t *mem, char reg) {
-	uint8_t psw; // place to store PSW, since we don't have a register to put it in. Only used in POP PSW
-	uint8_t *low;
-	uint8_t *high;
-	
-	switch(reg) {
-		case 'B':
-			low = &cpu->c;
-			high = &cpu->b;
-			break;
-		case 'D':
-			low = &cpu->e;
-			high = &cpu->d;
-			break;
-		case 'H':
-			low = &cpu->l;
-			high = &cpu->h;
-			break;
-		case 'P': /* PSW - Program Status Word. special handling - again low = PSW */
-			low = &psw;
-			stack_pop(cpu, mem, low, &cpu->a);
-			cpu->flags.cy = *low & 0x01;
-			cpu->flags.p = (*low & 0x04) >> 2;
-			cpu->flags.ac = (*low & 0x10) >> 4;
-			cpu->flags.z = (*low & 0x40) >> 6;
-			cpu->flags.s = (*low & 0x80) >> 7;
-			return;
-	}
-
-	stack_pop(cpu, mem, low, high);
+	cpu->a = (cpu->a >> 1) | (flag_cy(cpu) << 7);
+	cpu->flags = (cpu->flags & ~FLAG_CY) | low_bit;
 }
 
 /* STA - store accumulator direct. stores the value in register A to the given memory address. -- 13 cycles -- */
 void STA(CPU *cpu, uint8_t *mem, uint16_t addr) {
-	mem[addr] = cpu->a;
+	write_byte(cpu, mem, addr, cpu->a);
 }
 
 /* LDA - load accumulator direct. loads the value at the given address into register A. -- 13 cycles -- */
@@ -907,38 +954,6 @@ void LDA(CPU *cpu, uint8_t *mem, uint16_t addr) {
 	cpu->a = mem[addr];
 }
 
-/* STAX - store accumulator. stores the value in register A into the memory address given by the concatenation of the given register and its neighbor. -- 7 cycles -- */
-void STAX(CPU *cpu, uint8_t *mem, char reg) {
-	uint16_t address;
-
-	switch(reg) {
-		case 'B':
-			address = to_double_word(cpu->c, cpu->b);
-			break;
-		case 'D':
-			address = to_double_word(cpu->e, cpu->d);
-			break;
-	}
-
-	mem[address] = cpu->a;
-}
-
-/* LDAX - load accumulator. Loads the value stored at the memory address given by the register pair into register A. -- 7 cycles -- */
-void LDAX(CPU *cpu, uint8_t *mem, char reg) {
-	uint16_t address;
-
-	switch(reg) {
-		case 'B':
-			address = to_double_word(cpu->c, cpu->b);
-			break;
-		case 'D':
-			address = to_double_word(cpu->e, cpu->d);
-			break;
-	}
-
-	cpu->a = mem[address];
-}
-
 /* JMP - jump. program resumes execution at the given address. -- 10 cycles -- */
 void JMP(CPU *cpu, uint16_t addr) {
 	cpu->pc = addr;
@@ -946,56 +961,56 @@ void JMP(CPU *cpu, uint16_t addr) {
 
 /* JZ - jump if zero. If zero bit is set, calls JMP. -- 10 cycles -- */
 void JZ(CPU *cpu, uint16_t addr) {
-	if(cpu->flags.z == 1) {
+	if(flag_z(cpu) == 1) {
 		cpu->pc = addr;
 	}
 }
 
 /* JNZ - jump if not zero. If zero bit is not set, calls JMP. -- 10 cycles -- */
 void JNZ(CPU *cpu, uint16_t addr) {
-	if(cpu->flags.z == 0) {
+	if(flag_z(cpu) == 0) {
 		cpu->pc = addr;
 	}
 }
 
 /* JM - jump if negative. If sign bit is set, calls JMP. -- 10 cycles -- */
 void JM(CPU *cpu, uint16_t addr) {
-	if(cpu->flags.s == 1) {
+	if(flag_s(cpu) == 1) {
 		cpu->pc = addr;
 	}
 }
 
 /* JP - jump if positive. If sign bit is not set, calls JMP. -- 10 cycles -- */
 void JP(CPU *cpu, uint16_t addr) {
-	if(cpu->flags.s == 0) {
+	if(flag_s(cpu) == 0) {
 		cpu->pc = addr;
 	}
 }
 
 /* JPE - jump if parity even. If parity bit is set, calls JMP. -- 10 cycles -- */
 void JPE(CPU *cpu, uint16_t addr) {
-	if(cpu->flags.p == 1) {
+	if(flag_p(cpu) == 1) {
 		cpu->pc = addr;
 	}
 }
 
 /* JPO - jump if parity odd. If parity bit is not set, calls JMP. -- 10 cycles -- */
 void JPO(CPU *cpu, uint16_t addr) {
-	if(cpu->flags.p == 0) {
+	if(flag_p(cpu) == 0) {
 		cpu->pc = addr;
 	}
 }
 
 /* JC - jump if carry. If carry bit is set, calls JMP. -- 10 cycles -- */
 void JC(CPU *cpu, uint16_t addr) {
-	if(cpu->flags.cy == 1) {
+	if(flag_cy(cpu) == 1) {
 		cpu->pc = addr;
 	}
 }
 
 /* JNC - jump if no carry. If carry bit is not set, calls JMP. -- 10 cycles -- */
 void JNC(CPU *cpu, uint16_t addr) {
-	if(cpu->flags.cy == 0) {
+	if(flag_cy(cpu) == 0) {
 		cpu->pc = addr;
 	}
 }
@@ -1006,83 +1021,75 @@ void CALL(CPU *cpu, uint8_t *mem, uint16_t addr) {
 }
 
 /* CZ - call if zero. If zero bit is set, calls CALL. -- 11 cycles if zero bit not set, 17 cycles otherwise -- */
-void CZ(CPU *cpu, uint8_t *mem, uint16_t addr) {
-	if(cpu->flags.z == 1) {
+uint8_t CZ(CPU *cpu, uint8_t *mem, uint16_t addr) {
+	if(flag_z(cpu) == 1) {
 		call(cpu, mem, addr);
+		return 17;
 	}
-	else {
-		cycle_override = 11;
-	}
+	return 11;
 }
 
 /* CNZ - call if not zero. If zero bit is not set, calls CALL. -- 11 cycles if zero bit set, 17 cycles if not -- */
-void CNZ(CPU *cpu, uint8_t *mem, uint16_t addr) {
-	if(cpu->flags.z == 0) {
+uint8_t CNZ(CPU *cpu, uint8_t *mem, uint16_t addr) {
+	if(flag_z(cpu) == 0) {
 		call(cpu, mem, addr);
+		return 17;
 	}
-	else {
-		cycle_override = 11;
-	}
+	return 11;
 }
 
 /* CM - call if negative. If sign bit is set, calls CALL. -- 11 cycles if sign bit not set, 17 cycles otherwise -- */
-void CM(CPU *cpu, uint8_t *mem, uint16_t addr) {
-	if(cpu->flags.s == 1) {
+uint8_t CM(CPU *cpu, uint8_t *mem, uint16_t addr) {
+	if(flag_s(cpu) == 1) {
 		call(cpu, mem, addr);
+		return 17;
 	}
-	else {
-		cycle_override = 11;
-	}
+	return 11;
 }
 
 /* CP - call if positive. If sign bit is not set, calls CALL. -- 11 cycles if sign bit set, 17 cycles if not -- */
-void CP(CPU *cpu, uint8_t *mem, uint16_t addr) {
-	if(cpu->flags.s == 0) {
+uint8_t CP(CPU *cpu, uint8_t *mem, uint16_t addr) {
+	if(flag_s(cpu) == 0) {
 		call(cpu, mem, addr);
+		return 17;
 	}
-	else {
-		cycle_override = 11;
-	}
+	return 11;
 }
 
 /* CPE - call if parity even. If parity bit is set, calls CALL. -- 11 cycles if parity bit not set, 17 cycles otherwise -- */
-void CPE(CPU *cpu, uint8_t *mem, uint16_t addr) {
-	if(cpu->flags.p == 1) {
+uint8_t CPE(CPU *cpu, uint8_t *mem, uint16_t addr) {
+	if(flag_p(cpu) == 1) {
 		call(cpu, mem, addr);
+		return 17;
 	}
-	else {
-		cycle_override = 11;
-	}
+	return 11;
 }
 
 /* CPO - call if parity odd. If parity bit is not set, calls CALL. -- 11 cycles if parity bit set, 17 cycles if not -- */
-void CPO(CPU *cpu, uint8_t *mem, uint16_t addr) {
-	if(cpu->flags.p == 0) {
+uint8_t CPO(CPU *cpu, uint8_t *mem, uint16_t addr) {
+	if(flag_p(cpu) == 0) {
 		call(cpu, mem, addr);
+		return 17;
 	}
-	else {
-		cycle_override = 11;
-	}
+	return 11;
 }
 
 /* CC - call if carry. If carry bit is set, calls CALL. -- 11 cycles if carry bit not set, 17 cycles otherwise -- */
-void CC(CPU *cpu, uint8_t *mem, uint16_t addr) {
-	if(cpu->flags.cy == 1) {
+uint8_t CC(CPU *cpu, uint8_t *mem, uint16_t addr) {
+	if(flag_cy(cpu) == 1) {
 		call(cpu, mem, addr);
+		return 17;
 	}
-	else {
-		cycle_override = 11;
-	}
+	return 11;
 }
 
 /* CNC - call if no carry. If carry bit is not set, calls CALL. -- 11 cycles if carry bit set, 17 cycles if not -- */
-void CNC(CPU *cpu, uint8_t *mem, uint16_t addr) {
-	if(cpu->flags.cy == 0) {
+uint8_t CNC(CPU *cpu, uint8_t *mem, uint16_t addr) {
+	if(flag_cy(cpu) == 0) {
 		call(cpu, mem, addr);
+		return 17;
 	}
-	else {
-		cycle_override = 11;
-	}
+	return 11;
 }
 
 /* RET - return. Pops two bytes off the stack into the program counter, resuming execution at that address. -- 10 cycles -- */
@@ -1091,83 +1098,75 @@ void RET(CPU *cpu, uint8_t *mem) {
 }
 
 /* RZ - return if zero. If zero bit is set, calls RET. -- 5 cycles if zero bit not set, 11 cycles otherwise -- */
-void RZ(CPU *cpu, uint8_t *mem) {
-	if(cpu->flags.z == 1) {
+uint8_t RZ(CPU *cpu, uint8_t *mem) {
+	if(flag_z(cpu) == 1) {
 		ret(cpu, mem);
+		return 11;
 	}
-	else {
-		cycle_override = 5;
-	}
+	return 5;
 }
 
 /* RNZ - return if not zero. If zero bit is not set, calls RET. -- 5 cycles if zero bit set, 11 cycles if not -- */
-void RNZ(CPU *cpu, uint8_t *mem) {
-	if(cpu->flags.z == 0) {
+uint8_t RNZ(CPU *cpu, uint8_t *mem) {
+	if(flag_z(cpu) == 0) {
 		ret(cpu, mem);
+		return 11;
 	}
-	else {
-		cycle_override = 5;
-	}
+	return 5;
 }
 
 /* RM - return if negative. If sign bit is set, calls RET. -- 5 cycles if sign bit not set, 11 cycles otherwise -- */
-void RM(CPU *cpu, uint8_t *mem) {
-	if(cpu->flags.s == 1) {
+uint8_t RM(CPU *cpu, uint8_t *mem) {
+	if(flag_s(cpu) == 1) {
 		ret(cpu, mem);
+		return 11;
 	}
-	else {
-		cycle_override = 5;
-	}
+	return 5;
 }
 
 /* RP - return if positive. If sign bit is not set, calls RET. -- 5 cycles if sign bit set, 11 cycles if not -- */
-void RP(CPU *cpu, uint8_t *mem) {
-	if(cpu->flags.s == 0) {
+uint8_t RP(CPU *cpu, uint8_t *mem) {
+	if(flag_s(cpu) == 0) {
 		ret(cpu, mem);
+		return 11;
 	}
-	else {
-		cycle_override = 5;
-	}
+	return 5;
 }
 
 /* RPE - return if parity even. If parity bit is set, calls RET. -- 5 cycles if parity bit not set, 11 cycles otherwise -- */
-void RPE(CPU *cpu, uint8_t *mem) {
-	if(cpu->flags.p == 1) {
+uint8_t RPE(CPU *cpu, uint8_t *mem) {
+	if(flag_p(cpu) == 1) {
 		ret(cpu, mem);
+		return 11;
 	}
-	else {
-		cycle_override = 5;
-	}
+	return 5;
 }
 
 /* RPO - return if parity odd. If parity bit is not set, calls RET. -- 5 cycles if parity bit set, 11 cycles if not -- */
-void RPO(CPU *cpu, uint8_t *mem) {
-	if(cpu->flags.p == 0) {
+uint8_t RPO(CPU *cpu, uint8_t *mem) {
+	if(flag_p(cpu) == 0) {
 		ret(cpu, mem);
+		return 11;
 	}
-	else {
-		cycle_override = 5;
-	}
+	return 5;
 }
 
 /* RC -- return if carry. If carry bit is set, calls RET. -- 5 cycles if carry bit not set, 11 cycles otherwise -- */
-void RC(CPU *cpu, uint8_t *mem) {
-	if(cpu->flags.cy == 1) {
+uint8_t RC(CPU *cpu, uint8_t *mem) {
+	if(flag_cy(cpu) == 1) {
 		ret(cpu, mem);
+		return 11;
 	}
-	else {
-		cycle_override = 5;
-	}
+	return 5;
 }
 
 /* RNC -- return if no carry. If carry bit is not set, calls RET. -- 5 cycles if carry bit set, 11 cycles if not -- */
-void RNC(CPU *cpu, uint8_t *mem) {
-	if(cpu->flags.cy == 0) {
+uint8_t RNC(CPU *cpu, uint8_t *mem) {
+	if(flag_cy(cpu) == 0) {
 		ret(cpu, mem);
+		return 11;
 	}
-	else {
-		cycle_override = 5;
-	}
+	return 5;
 }
 
 /* RST - restart/reset. CALLs a special memory address, located at or near the beginning of the program. Used for handling interrupts from peripheral devices. -- 11 cycles -- */
@@ -1177,8 +1176,8 @@ void RST(CPU *cpu, uint8_t *mem, uint8_t code) {
 
 /* SHLD - store H and L. Stores register L at the address specified, and H at address+1. -- 16 cycles -- */
 void SHLD(CPU *cpu, uint8_t *mem, uint16_t addr) {
-	mem[addr] = cpu->l;
-	mem[addr+1] = cpu->h;
+	write_byte(cpu, mem, addr, cpu->l);
+	write_byte(cpu, mem, addr+1, cpu->h);
 }
 
 /* LHLD - load H and L. Loads register L from the address specified, and H from address+1. -- 16 cycles -- */
@@ -1193,8 +1192,8 @@ void XTHL(CPU *cpu, uint8_t *mem) {
 	uint8_t reg_h = cpu->h;
 	cpu->l = mem[cpu->sp];
 	cpu->h = mem[cpu->sp+1];
-	mem[cpu->sp] = reg_l;
-	mem[cpu->sp+1] = reg_h;
+	write_byte(cpu, mem, cpu->sp, reg_l);
+	write_byte(cpu, mem, cpu->sp+1, reg_h);
 }
 
 /* XCHG - exchange H and L with D and E. swaps the values of registers H and D, and registers L and E. -- 4 cycles -- */
@@ -1219,43 +1218,37 @@ void PCHL(CPU *cpu) {
 
 /* STC - set carry. Sets the carry bit to 1. -- 4 cycles -- */
 void STC(CPU *cpu) {
-	cpu->flags.cy = 1;
+	cpu->flags |= FLAG_CY;
 }
 
 /* CMC - complement carry. Sets carry bit to its bitwise negation. -- 4 cycles -- */
 void CMC(CPU *cpu) {
-	cpu->flags.cy = cpu->flags.cy == 0 ? 1 : 0;
+	cpu->flags ^= FLAG_CY;
 }
 
 /* DAA - decimal adjust accumulator. Adjusts the value in the accumulator after a BCD operation to be a correct binary coded decimal value (each half-bye is a value in 0-9). -- 4 cycles -- */
 void DAA(CPU *cpu) {
+	materialize_flags(cpu);
+
 	uint8_t low_digit = cpu->a & 0x0f;
 
-	if(low_digit > 9 || cpu->flags.ac == 1) {
+	if(low_digit > 9 || (cpu->flags & FLAG_AC) == FLAG_AC) {
 		low_digit += 6;
-		if((low_digit & 0x10) == 0x10)
-			cpu->flags.ac = 1;
-		else
-			cpu->flags.ac = 0;
+		cpu->flags = (cpu->flags & ~FLAG_AC) | (low_digit & FLAG_AC); /* a carry out of the low digit lands on bit 4 */
 	}
 
 	uint16_t result = (cpu->a & 0xf0) + low_digit;
 	uint8_t high_digit = (result & 0x00f0) >> 4;
 
-	if(high_digit > 9 || cpu->flags.cy == 1) {
+	if(high_digit > 9 || flag_cy(cpu) == 1) {
 		high_digit += 6;
-		if((high_digit & 0x10) == 0x10)
-			cpu->flags.cy = 1;
-		else
-			cpu->flags.cy = 0;
+		cpu->flags = (cpu->flags & ~FLAG_CY) | ((high_digit & 0x10) >> 4);
 	}
 
 	result = (result & 0xff0f) + (high_digit << 4);
 	cpu->a = (uint8_t)result;
 
-	set_z(&cpu->flags, result);
-	set_s(&cpu->flags, result);
-	set_p(&cpu->flags, result);
+	set_zsp(&cpu->flags, result);
 }
 
 /* IN - input. reads 8 bits of data from the specified port into the A register. -- 10 cycles -- */
@@ -1301,40 +1294,12 @@ void HLT(CPU *cpu) {
 	cpu->halted = 1;
 }
 
-void set_z(Flags *flags, uint16_t result) {
-	if((result & 0x00ff) == 0) {
-		flags->z = 1;
-	}
-	else {
-		flags->z = 0;
-	}
-}
-
-void set_s(Flags *flags, uint16_t result) {
-	if((result & 0x0080) == 0x80) {
-		flags->s = 1;
-	}
-	else {
-		flags->s = 0;
-	}
-}
-
-void set_p(Flags *flags, uint16_t result) {
-	if((result & 0x0001) == 0) {
-		flags->p = 1;
-	}
-	else {
-		flags->p = 0;
-	}
+void set_zsp(Flags *flags, uint8_t result) {
+	*flags = (*flags & ~(FLAG_Z | FLAG_S | FLAG_P)) | zspFlags[result];
 }
 
 void set_cy(Flags *flags, uint16_t result) {
-	if((result & 0x0100) == 0x0100) {
-		flags->cy = 1;
-	}
-	else {
-		flags->cy = 0;
-	}
+	*flags = (*flags & ~FLAG_CY) | ((result >> 8) & FLAG_CY);
 }
 
 void unimplemented(CPU *cpu, uint8_t opcode) {
@@ -1342,388 +1307,24 @@ void unimplemented(CPU *cpu, uint8_t opcode) {
 	exit(1);
 }
 
-void initializeOpLengths(uint8_t *lengths) {
-	int i;
-	for(i = 0; i < NUM_OF_OPCODES; ++i) {
-		lengths[i] = 1;
-	}
-	lengths[0x01] =  3;
-	lengths[0x06] = 2;
-	lengths[0x0e] = 2;
-	lengths[0x11] =  3;
-	lengths[0x16] = 2;
-	lengths[0x1e] = 2;
-	lengths[0x21] =  3;
-	lengths[0x22] =  3;
-	lengths[0x26] = 2;
-	lengths[0x2a] =  3;
-	lengths[0x2e] = 2;
-	lengths[0x31] =  3;
-	lengths[0x32] =  3;
-	lengths[0x36] = 2;
-	lengths[0x3a] =  3;
-	lengths[0x3e] = 2;
-	lengths[0xc2] =  3;
-	lengths[0xc3] =  3;
-	lengths[0xc4] =  3;
-	lengths[0xc6] = 2;
-	lengths[0xca] =  3;
-	lengths[0xcc] =  3;
-	lengths[0xcd] =  3;
-	lengths[0xce] = 2;
-	lengths[0xd2] =  3;
-	lengths[0xd3] = 2;
-	lengths[0xd4] =  3;
-	lengths[0xd6] = 2;
-	lengths[0xda] =  3;
-	lengths[0xdb] = 2;
-	lengths[0xdc] =  3;
-	lengths[0xde] = 2;
-	lengths[0xe2] =  3;
-	lengths[0xe4] =  3;
-	lengths[0xe6] = 2;
-	lengths[0xea] =  3;
-	lengths[0xec] =  3;
-	lengths[0xee] = 2;
-	lengths[0xf2] =  3;
-	lengths[0xf4] =  3;
-	lengths[0xf6] = 2;
-	lengths[0xfa] =  3;
-	lengths[0xfc] =  3;
-	lengths[0xfe] = 2;
-}
-
-void initializeOpCycles(uint8_t *cycles) {
-	int i;
-	for(i = 0; i < NUM_OF_OPCODES; ++i) {
-		cycles[i] = 255; // a placeholder value. Check for it in the CPU loop, if you see it, you done fucked up
+void initializeZSPFlags(uint8_t *table) {
+	int i, b;
+	for(i = 0; i < 0x100; ++i) {
+		int bits_set = 0;
+		for(b = 0; b < 8; ++b) {
+			bits_set += (i >> b) & 0x01;
+		}
+		table[i] = 0;
+		if(i == 0) {
+			table[i] |= FLAG_Z;
+		}
+		if((i & 0x80) == 0x80) {
+			table[i] |= FLAG_S;
+		}
+		if((bits_set & 0x01) == 0) { /* parity is even when an even number of bits are set */
+			table[i] |= FLAG_P;
+		}
 	}
-	// NOP
-	cycles[0x00] = 4;
-	// MVI
-	cycles[0x06] =  7;
-	cycles[0x0e] =  7;
-	cycles[0x16] =  7;
-	cycles[0x1e] =  7;
-	cycles[0x26] =  7;
-	cycles[0x2e] =  7;
-	cycles[0x36] =   10;
-	cycles[0x3e] =  7;
-	// LXI
-	cycles[0x01] =   10;
-	cycles[0x11] =   10;
-	cycles[0x21] =   10;
-	cycles[0x31] =   10;
-	// INR
-	cycles[0x04] = 5;
-	cycles[0x0c] = 5;
-	cycles[0x14] = 5;
-	cycles[0x1c] = 5;
-	cycles[0x24] = 5;
-	cycles[0x2c] = 5;
-	cycles[0x34] =   10;
-	cycles[0x3c] = 5;
-	// DCR
-	cycles[0x05] = 5;
-	cycles[0x0d] = 5;
-	cycles[0x15] = 5;
-	cycles[0x1d] = 5;
-	cycles[0x25] = 5;
-	cycles[0x2d] = 5;
-	cycles[0x35] =   10;
-	cycles[0x3d] = 5;
-	// INX
-	cycles[0x03] = 5;
-	cycles[0x13] = 5;
-	cycles[0x23] = 5;
-	cycles[0x33] = 5;
-	// DCX
-	cycles[0x0b] = 5;
-	cycles[0x1b] = 5;
-	cycles[0x2b] = 5;
-	cycles[0x3b] = 5;
-	// DAD
-	cycles[0x09] =   10;
-	cycles[0x19] =   10;
-	cycles[0x29] =   10;
-	cycles[0x39] =   10;
-	// ADI
-	cycles[0xc6] =  7;
-	// SUI
-	cycles[0xd6] =  7;
-	// ACI
-	cycles[0xce] =  7;
-	// SBI
-	cycles[0xde] =  7;
-	// CPI
-	cycles[0xfe] =  7;
-	// ANI
-	cycles[0xe6] =  7;
-	// ORI
-	cycles[0xf6] =  7;
-	// XRI
-	cycles[0xee] =  7;
-	// MOV
-	cycles[0x40] = 5;
-	cycles[0x41] = 5;
-	cycles[0x42] = 5;
-	cycles[0x43] = 5;
-	cycles[0x44] = 5;
-	cycles[0x45] = 5;
-	cycles[0x46] =  7;
-	cycles[0x47] = 5;
-	cycles[0x48] = 5;
-	cycles[0x49] = 5;
-	cycles[0x4a] = 5;
-	cycles[0x4b] = 5;
-	cycles[0x4c] = 5;
-	cycles[0x4d] = 5;
-	cycles[0x4e] =  7;
-	cycles[0x4f] = 5;
-	cycles[0x50] = 5;
-	cycles[0x51] = 5;
-	cycles[0x52] = 5;
-	cycles[0x53] = 5;
-	cycles[0x54] = 5;
-	cycles[0x55] = 5;
-	cycles[0x56] =  7;
-	cycles[0x57] = 5;
-	cycles[0x58] = 5;
-	cycles[0x59] = 5;
-	cycles[0x5a] = 5;
-	cycles[0x5b] = 5;
-	cycles[0x5c] = 5;
-	cycles[0x5d] = 5;
-	cycles[0x5e] =  7;
-	cycles[0x5f] = 5;
-	cycles[0x60] = 5;
-	cycles[0x61] = 5;
-	cycles[0x62] = 5;
-	cycles[0x63] = 5;
-	cycles[0x64] = 5;
-	cycles[0x65] = 5;
-	cycles[0x66] =  7;
-	cycles[0x67] = 5;
-	cycles[0x68] = 5;
-	cycles[0x69] = 5;
-	cycles[0x6a] = 5;
-	cycles[0x6b] = 5;
-	cycles[0x6c] = 5;
-	cycles[0x6d] = 5;
-	cycles[0x6e] =  7;
-	cycles[0x6f] = 5;
-	cycles[0x70] =  7;
-	cycles[0x71] =  7;
-	cycles[0x72] =  7;
-	cycles[0x73] =  7;
-	cycles[0x74] =  7;
-	cycles[0x75] =  7;
-	cycles[0x77] =  7;
-	cycles[0x78] = 5;
-	cycles[0x79] = 5;
-	cycles[0x7a] = 5;
-	cycles[0x7b] = 5;
-	cycles[0x7c] = 5;
-	cycles[0x7d] = 5;
-	cycles[0x7e] =  7;
-	cycles[0x7f] = 5;
-	// ADD
-	cycles[0x80] = 4;
-	cycles[0x81] = 4;
-	cycles[0x82] = 4;
-	cycles[0x83] = 4;
-	cycles[0x84] = 4;
-	cycles[0x85] = 4;
-	cycles[0x86] =  7;
-	cycles[0x87] = 4;
-	// SUB
-	cycles[0x90] = 4;
-	cycles[0x91] = 4;
-	cycles[0x92] = 4;
-	cycles[0x93] = 4;
-	cycles[0x94] = 4;
-	cycles[0x95] = 4;
-	cycles[0x96] =  7;
-	cycles[0x97] = 4;
-	// ADC
-	cycles[0x88] = 4;
-	cycles[0x89] = 4;
-	cycles[0x8a] = 4;
-	cycles[0x8b] = 4;
-	cycles[0x8c] = 4;
-	cycles[0x8d] = 4;
-	cycles[0x8e] =  7;
-	cycles[0x8f] = 4;
-	// SBB
-	cycles[0x98] = 4;
-	cycles[0x99] = 4;
-	cycles[0x9a] = 4;
-	cycles[0x9b] = 4;
-	cycles[0x9c] = 4;
-	cycles[0x9d] = 4;
-	cycles[0x9e] =  7;
-	cycles[0x9f] = 4;
-	// CMP
-	cycles[0xb8] = 4;
-	cycles[0xb9] = 4;
-	cycles[0xba] = 4;
-	cycles[0xbb] = 4;
-	cycles[0xbc] = 4;
-	cycles[0xbd] = 4;
-	cycles[0xbe] =  7;
-	cycles[0xbf] = 4;
-	// ANA
-	cycles[0xa0] = 4;
-	cycles[0xa1] = 4;
-	cycles[0xa2] = 4;
-	cycles[0xa3] = 4;
-	cycles[0xa4] = 4;
-	cycles[0xa5] = 4;
-	cycles[0xa6] =  7;
-	cycles[0xa7] = 4;
-	// ORA
-	cycles[0xb0] = 4;
-	cycles[0xb1] = 4;
-	cycles[0xb2] = 4;
-	cycles[0xb3] = 4;
-	cycles[0xb4] = 4;
-	cycles[0xb5] = 4;
-	cycles[0xb6] =  7;
-	cycles[0xb7] = 4;
-	// XRA
-	cycles[0xa8] = 4;
-	cycles[0xa9] = 4;
-	cycles[0xaa] = 4;
-	cycles[0xab] = 4;
-	cycles[0xac] = 4;
-	cycles[0xad] = 4;
-	cycles[0xae] =  7;
-	cycles[0xaf] = 4;
-	// CMA
-	cycles[0x2f] = 4;
-	// RLC
-	cycles[0x07] = 4;
-	// RRC
-	cycles[0x0f] = 4;
-	// RAL
-	cycles[0x17] = 4;
-	// RAR
-	cycles[0x1f] = 4;
-	// PUSH
-	cycles[0xc5] =   11;
-	cycles[0xd5] =   11;
-	cycles[0xe5] =   11;
-	cycles[0xf5] =   11;
-	// POP
-	cycles[0xc1] =   10;
-	cycles[0xd1] =   10;
-	cycles[0xe1] =   10;
-	cycles[0xf1] =   10;
-	// STA
-	cycles[0x32] =    13;
-	// LDA
-	cycles[0x3a] =    13;
-	// STAX
-	cycles[0x02] =  7;
-	cycles[0x12] =  7;
-	// LDAX
-	cycles[0x0a] =  7;
-	cycles[0x1a] =  7;
-	// JMP
-	cycles[0xc3] =   10;
-	// JZ
-	cycles[0xca] =   10;
-	// JNZ
-	cycles[0xc2] =   10;
-	// JM
-	cycles[0xfa] =   10;
-	// JP
-	cycles[0xf2] =   10;
-	// JPE
-	cycles[0xea] =   10;
-	// JPO
-	cycles[0xe2] =   10;
-	// JC
-	cycles[0xda] =   10;
-	// JNC
-	cycles[0xd2] =   10;
-	// CALL
-	cycles[0xcd] =     17;
-	// CZ
-	cycles[0xcc] =     17; // 11 if zero bit not set. uses override
-	// CNZ
-	cycles[0xc4] =     17; // 11 if zero bit set. uses override
-	// CM
-	cycles[0xfc] =     17; // 11 if sign bit not set. uses override
-	// CP
-	cycles[0xf4] =     17; // 11 if sign bit set. uses override
-	// CPE
-	cycles[0xec] =     17; // 11 if parity bit not set. uses override
-	// CPO
-	cycles[0xe4] =     17; // 11 if parity bit set. uses override
-	// CC
-	cycles[0xdc] =     17; // 11 if carry bit not set. uses override
-	// CNC
-	cycles[0xd4] =     17; // 11 if carry bit set. uses override
-	// RET
-	cycles[0xc9] =   10;
-	// RZ
-	cycles[0xc8] =   11; // 5 if zero bit not set. uses override
-	// RNZ
-	cycles[0xc0] =   11; // 5 if zero bit set. uses override
-	// RM
-	cycles[0xf8] =   11; // 5 if sign bit not set. uses override.
-	// RP
-	cycles[0xf0] =   11; // 5 if sign bit set. uses override
-	// RPE
-	cycles[0xe8] =   11; // 5 if parity bit not set. uses override
-	// RPO
-	cycles[0xe0] =   11; // 5 if parity bit set. uses override
-	// RC
-	cycles[0xd8] =   11; // 5 if carry bit not set. uses override
-	// RNC
-	cycles[0xd0] =   11; // 5 if carry bit set. uses override
-	// RST
-	cycles[0xc7] =   11;
-	cycles[0xcf] =   11;
-	cycles[0xd7] =   11;
-	cycles[0xdf] =   11;
-	cycles[0xe7] =   11;
-	cycles[0xef] =   11;
-	cycles[0xf7] =   11;
-	cycles[0xff] =   11;
-	// SHLD
-	cycles[0x22] =     16;
-	// LHLD
-	cycles[0x2a] =     16;
-	// XTHL
-	cycles[0xe3] =     18;
-	// XCHG
-	cycles[0xeb] = 4;
-	// SPHL
-	cycles[0xf9] = 5;
-	// PCHL
-	cycles[0xe9] = 5;
-	// STC
-	cycles[0x37] = 4;
-	// CMC
-	cycles[0x3f] = 4;
-	// DAA
-	cycles[0x27] = 4;
-	// IN
-	cycles[0xdb] =   10;
-	// OUT
-	cycles[0xd3] =   10;
-	// RIM
-	cycles[0x20] = 4;
-	// SIM
-	cycles[0x30] = 4;
-	// DI
-	cycles[0xf3] = 4;
-	// EI
-	cycles[0xfb] = 4;
-	// HLT
-	cycles[0x76] =  7;
 }
 
 uint16_t to_double_word(uint8_t low, uint8_t high) {
@@ -1739,8 +1340,8 @@ void from_double_word(uint16_t dword, uint8_t *low, uint8_t *high) {
 }
 
 void stack_push(CPU *cpu, uint8_t *mem, uint8_t byte1, uint8_t byte2) {
-	mem[cpu->sp - 1] = byte1;
-	mem[cpu->sp - 2] = byte2;
+	write_byte(cpu, mem, cpu->sp - 1, byte1);
+	write_byte(cpu, mem, cpu->sp - 2, byte2);
 	cpu->sp = cpu->sp - 2;
 }
 
@@ -1765,21 +1366,6 @@ void ret(CPU *cpu, uint8_t *mem) {
 	cpu->pc = to_double_word(low, high);
 }
 
-uint8_t *get_register(CPU *cpu, uint8_t *mem, char reg) {
-	switch(reg) {
-		case 'B': return &cpu->b;
-		case 'C': return &cpu->c;
-		case 'D': return &cpu->d;
-		case 'E': return &cpu->e;
-		case 'H': return &cpu->h;
-		case 'L': return &cpu->l;
-		case 'M':
-			return &mem[to_double_word(cpu->l, cpu->h)]; /* the M register is the memory location addressed by H and L */
-		case 'A': return &cpu->a;
-		default: return 0;
-	}
-}
-
 uint8_t two_comp(uint8_t i) {
 	return ~i + 1;
 }
@@ -2,6 +2,7 @@
 #define SPINV_CPU8080
 
 #include "interrupts.h"
+#include "blockcache.h"
 
 #include <stdint.h>
 
@@ -10,14 +11,30 @@
 
 #define NUM_OF_OPCODES 0x100
 
-typedef struct { /* z:1 means z is exactly 1 bit. z, and the following five registers, will be packed into a single byte as they only take up 8 bits total. */
-	uint8_t z:1;   /* ZERO - did the last instruction equal 0? */
-	uint8_t s:1;   /* SIGN - did the last instruction set bit 7? (this means it's negative - IF using signed integers.) */
-	uint8_t p:1;   /* PARITY - did the last instruction return an even value? */
-	uint8_t cy:1;  /* CARRY - 1 if the previous operation resulted in overflow. 0 otherwise. I think. */
-	uint8_t ac:1;  /* AUX CARRY - used for BCD (binary coded decimal) math. 1 if the first half-byte overflowed, 0 otherwise. */
-	uint8_t pad:3; /* padding - unused */
-} Flags;
+#define MEMORY_SIZE 0x4000 /* ROM and RAM. The RAM mirror at $4000-$7fff is not implemented */
+#define ROM_SIZE 0x2000 /* ROM occupies $0000-$1fff, and cannot be written to */
+#define VRAM_START_ADDRESS 0x2400 /* VRAM goes from 0x2400-3FFF, each bit mapping to one pixel */
+#define VRAM_LINE_SHIFT 5 /* VRAM is drawn 32 bytes to a line */
+#define NUM_OF_VRAM_LINES ((MEMORY_SIZE - VRAM_START_ADDRESS) >> VRAM_LINE_SHIFT)
+
+/* Flags are stored exactly as the 8080 lays them out in the low byte of the PSW, so pushing and popping PSW is a plain byte copy. */
+#define FLAG_CY 0x01 /* CARRY - 1 if the previous operation resulted in overflow. 0 otherwise. */
+#define FLAG_P  0x04 /* PARITY - did the last instruction leave an even number of bits set? */
+#define FLAG_AC 0x10 /* AUX CARRY - used for BCD (binary coded decimal) math. 1 if the first half-byte overflowed, 0 otherwise. */
+#define FLAG_Z  0x40 /* ZERO - did the last instruction equal 0? */
+#define FLAG_S  0x80 /* SIGN - did the last instruction set bit 7? (this means it's negative - IF using signed integers.) */
+#define FLAG_MASK (FLAG_CY | FLAG_P | FLAG_AC | FLAG_Z | FLAG_S)
+#define FLAG_ALWAYS_SET 0x02 /* bit 1 is not a flag, and always reads as 1. bits 3 and 5 always read as 0. */
+
+typedef uint8_t Flags;
+
+/* When flags are evaluated lazily, flag-setting operations only record what they need here. z, s, p and ac are derived from it on demand. */
+typedef struct {
+	uint8_t result;  /* the result of the last operation, from which z, s and p follow */
+	uint8_t ac_lhs;  /* ac is the carry out of bit 3 from adding the low half of ac_lhs to ac_rhs */
+	uint8_t ac_rhs;
+	uint8_t pending; /* 1 if z, s, p and ac in Flags are out of date */
+} LazyFlags;
 
 typedef struct {
 	/* registers */
@@ -32,35 +49,42 @@ typedef struct {
 	uint16_t pc; /* PROGRAM COUNTER - address of current instruction */
 	/* flags */
 	Flags    flags;
+	LazyFlags lazy_flags; /* use materialize_flags() before reading z, s, p or ac from outside the CPU */
 	/* CPU state - interrupt handling */
 	uint8_t  interrupt_instruction[3];
 	//uint8_t  inte:1; /* are interrupts enabled? named so because the actual bit is named INTE on an 8080 CPU - now handled by interrupts.h */
 	uint8_t  has_interrupt:1; /* has an interrupt occurred? */
 	uint8_t  halted:1; /* is the CPU halted? */
+	/* decoded code, so that instructions are only decoded the first time they run */
+	BlockCache *block_cache;
+	/* 1 for each line of VRAM written to since the emulator last took a frame from it, which it clears as it does */
+	uint8_t  vram_dirty[NUM_OF_VRAM_LINES];
 } CPU;
 /* M - refers to the memory contents at (HL) */
 /* PSW (Program Status Word) - refers to A and FLAGS as a two-byte pair */
 
 void initializeCPU(CPU *cpu);
+void destroyCPU(CPU *cpu);
 void printCPU(CPU *cpu, uint8_t *mem);
+void materialize_flags(CPU *cpu);
 
+/* runs a single instruction, and returns the number of cycles it took */
 uint8_t emulate(CPU *cpu, uint8_t *mem, Interrupt *interrupts);
+/* runs instructions back to back until at least budget cycles have elapsed, and returns exactly how many did. The last instruction may carry
+ * the total a few cycles past the budget. Interrupts are not checked for until the next call. */
+unsigned long run_cycles(CPU *cpu, uint8_t *mem, Interrupt *interrupts, unsigned long budget);
+
+/* fill in the length in bytes, and the cycles taken, of every opcode. defined in cpu8080_tables.c */
+void initializeOpLengths(uint8_t *lengths);
+void initializeOpCycles(uint8_t *cycles);
 
 /* operations */
 
 void unimplemented(CPU *cpu, uint8_t opcode);
 void NOP(CPU *cpu);
 
-void MVI(CPU *cpu, uint8_t *mem, char reg, uint8_t imm);
-void LXI(CPU *cpu, char reg, uint16_t imm);
-
-void INR(CPU *cpu, uint8_t *mem, char reg);
-void DCR(CPU *cpu, uint8_t *mem, char reg);
-
-void INX(CPU *cpu, char reg);
-void DCX(CPU *cpu, char reg);
-
-void DAD(CPU *cpu, char reg);
+/* MVI, LXI, INR, DCR, INX, DCX, DAD, MOV, ADD, ADC, SUB, SBB, ANA, XRA, ORA, CMP, PUSH, POP, STAX and LDAX are generated once per operand
+ * inside cpu8080.c (MOV_B_C, PUSH_PSW...), as the opcode already determines which registers they use. */
 
 void ADI(CPU *cpu, uint8_t imm);
 void SUI(CPU *cpu, uint8_t imm);
@@ -73,33 +97,15 @@ void ANI(CPU *cpu, uint8_t imm);
 void ORI(CPU *cpu, uint8_t imm);
 void XRI(CPU *cpu, uint8_t imm);
 
-void MOV(CPU *cpu, uint8_t *mem, char dreg, char sreg);
-
-void ADD(CPU *cpu, uint8_t *mem, char reg);
-void SUB(CPU *cpu, uint8_t *mem, char reg);
-void ADC(CPU *cpu, uint8_t *mem, char reg);
-void SBB(CPU *cpu, uint8_t *mem, char reg);
-
-void CMP(CPU *cpu, uint8_t *mem, char reg);
-
-void ANA(CPU *cpu, uint8_t *mem, char reg);
-void ORA(CPU *cpu, uint8_t *mem, char reg);
-void XRA(CPU *cpu, uint8_t *mem, char reg);
 void CMA(CPU *cpu);
 void RLC(CPU *cpu);
 void RRC(CPU *cpu);
 void RAL(CPU *cpu);
 void RAR(CPU *cpu);
 
-void PUSH(CPU *cpu, uint8_t *mem, char reg);
-void POP(CPU *cpu, uint8_t *mem, char reg);
-
 void STA(CPU *cpu, uint8_t *mem, uint16_t addr);
 void LDA(CPU *cpu, uint8_t *mem, uint16_t addr);
 
-void STAX(CPU *cpu, uint8_t *mem, char reg);
-void LDAX(CPU *cpu, uint8_t *mem, char reg);
-
 void JMP(CPU *cpu, uint16_t addr);
 void JZ(CPU *cpu, uint16_t addr);
 void JNZ(CPU *cpu, uint16_t addr);
@@ -111,24 +117,24 @@ void JC(CPU *cpu, uint16_t addr);
 void JNC(CPU *cpu, uint16_t addr);
 
 void CALL(CPU *cpu, uint8_t *mem, uint16_t addr);
-void CZ(CPU *cpu, uint8_t *mem, uint16_t addr);
-void CNZ(CPU *cpu, uint8_t *mem, uint16_t addr);
-void CM(CPU *cpu, uint8_t *mem, uint16_t addr);
-void CP(CPU *cpu, uint8_t *mem, uint16_t addr);
-void CPE(CPU *cpu, uint8_t *mem, uint16_t addr);
-void CPO(CPU *cpu, uint8_t *mem, uint16_t addr);
-void CC(CPU *cpu, uint8_t *mem, uint16_t addr);
-void CNC(CPU *cpu, uint8_t *mem, uint16_t addr);
+uint8_t CZ(CPU *cpu, uint8_t *mem, uint16_t addr);
+uint8_t CNZ(CPU *cpu, uint8_t *mem, uint16_t addr);
+uint8_t CM(CPU *cpu, uint8_t *mem, uint16_t addr);
+uint8_t CP(CPU *cpu, uint8_t *mem, uint16_t addr);
+uint8_t CPE(CPU *cpu, uint8_t *mem, uint16_t addr);
+uint8_t CPO(CPU *cpu, uint8_t *mem, uint16_t addr);
+uint8_t CC(CPU *cpu, uint8_t *mem, uint16_t addr);
+uint8_t CNC(CPU *cpu, uint8_t *mem, uint16_t addr);
 
 void RET(CPU *cpu, uint8_t *mem);
-void RZ(CPU *cpu, uint8_t *mem);
-void RNZ(CPU *cpu, uint8_t *mem);
-void RM(CPU *cpu, uint8_t *mem);
-void RP(CPU *cpu, uint8_t *mem);
-void RPE(CPU *cpu, uint8_t *mem);
-void RPO(CPU *cpu, uint8_t *mem);
-void RC(CPU *cpu, uint8_t *mem);
-void RNC(CPU *cpu, uint8_t *mem);
+uint8_t RZ(CPU *cpu, uint8_t *mem);
+uint8_t RNZ(CPU *cpu, uint8_t *mem);
+uint8_t RM(CPU *cpu, uint8_t *mem);
+uint8_t RP(CPU *cpu, uint8_t *mem);
+uint8_t RPE(CPU *cpu, uint8_t *mem);
+uint8_t RPO(CPU *cpu, uint8_t *mem);
+uint8_t RC(CPU *cpu, uint8_t *mem);
+uint8_t RNC(CPU *cpu, uint8_t *mem);
 
 void RST(CPU *cpu, uint8_t *mem, uint8_t code);
 
@@ -0,0 +1,259 @@
+/* Opcode table for the 8080 core.
+ * Each line pairs an opcode with how its cycles are counted and the statement that executes it. This file is an X-macro list: it has no include
+ * guard, and is included once for every place that needs to expand the table (the dispatch table, the threaded handlers, the switch fallback,
+ * the startup check of cycle counts, and the static recompiler). The includer must define OP(code, timing, ...) beforehand; it is undefined
+ * again at the end of this file.
+ * Handlers may refer to cpu, mem, interrupts, and IMM8 or IMM16 (the immediate operand of the instruction).
+ * timing is FIXED for instructions that always take the cycles opCycles gives them. Instructions that take fewer cycles when their condition
+ * fails (conditional calls and returns) are TIMED: their handlers return the exact number of cycles taken, and count their own cycles. Includers
+ * that expand the statements as timing(statement) must define both FIXED(statement) and TIMED(exact).
+ */
+
+OP(0x00, FIXED, NOP(cpu))
+OP(0x01, FIXED, LXI_B(cpu, IMM16))
+OP(0x02, FIXED, STAX_B(cpu, mem))
+OP(0x03, FIXED, INX_B(cpu))
+OP(0x04, FIXED, INR_B(cpu, mem))
+OP(0x05, FIXED, DCR_B(cpu, mem))
+OP(0x06, FIXED, MVI_B(cpu, mem, IMM8))
+OP(0x07, FIXED, RLC(cpu))
+OP(0x09, FIXED, DAD_B(cpu))
+OP(0x0a, FIXED, LDAX_B(cpu, mem))
+OP(0x0b, FIXED, DCX_B(cpu))
+OP(0x0c, FIXED, INR_C(cpu, mem))
+OP(0x0d, FIXED, DCR_C(cpu, mem))
+OP(0x0e, FIXED, MVI_C(cpu, mem, IMM8))
+OP(0x0f, FIXED, RRC(cpu))
+OP(0x11, FIXED, LXI_D(cpu, IMM16))
+OP(0x12, FIXED, STAX_D(cpu, mem))
+OP(0x13, FIXED, INX_D(cpu))
+OP(0x14, FIXED, INR_D(cpu, mem))
+OP(0x15, FIXED, DCR_D(cpu, mem))
+OP(0x16, FIXED, MVI_D(cpu, mem, IMM8))
+OP(0x17, FIXED, RAL(cpu))
+OP(0x19, FIXED, DAD_D(cpu))
+OP(0x1a, FIXED, LDAX_D(cpu, mem))
+OP(0x1b, FIXED, DCX_D(cpu))
+OP(0x1c, FIXED, INR_E(cpu, mem))
+OP(0x1d, FIXED, DCR_E(cpu, mem))
+OP(0x1e, FIXED, MVI_E(cpu, mem, IMM8))
+OP(0x1f, FIXED, RAR(cpu))
+OP(0x20, FIXED, RIM(cpu))
+OP(0x21, FIXED, LXI_H(cpu, IMM16))
+OP(0x22, FIXED, SHLD(cpu, mem, IMM16))
+OP(0x23, FIXED, INX_H(cpu))
+OP(0x24, FIXED, INR_H(cpu, mem))
+OP(0x25, FIXED, DCR_H(cpu, mem))
+OP(0x26, FIXED, MVI_H(cpu, mem, IMM8))
+OP(0x27, FIXED, DAA(cpu))
+OP(0x29, FIXED, DAD_H(cpu))
+OP(0x2a, FIXED, LHLD(cpu, mem, IMM16))
+OP(0x2b, FIXED, DCX_H(cpu))
+OP(0x2c, FIXED, INR_L(cpu, mem))
+OP(0x2d, FIXED, DCR_L(cpu, mem))
+OP(0x2e, FIXED, MVI_L(cpu, mem, IMM8))
+OP(0x2f, FIXED, CMA(cpu))
+OP(0x30, FIXED, SIM(cpu))
+OP(0x31, FIXED, LXI_SP(cpu, IMM16))
+OP(0x32, FIXED, STA(cpu, mem, IMM16))
+OP(0x33, FIXED, INX_SP(cpu))
+OP(0x34, FIXED, INR_M(cpu, mem))
+OP(0x35, FIXED, DCR_M(cpu, mem))
+OP(0x36, FIXED, MVI_M(cpu, mem, IMM8))
+OP(0x37, FIXED, STC(cpu))
+OP(0x39, FIXED, DAD_SP(cpu))
+OP(0x3a, FIXED, LDA(cpu, mem, IMM16))
+OP(0x3b, FIXED, DCX_SP(cpu))
+OP(0x3c, FIXED, INR_A(cpu, mem))
+OP(0x3d, FIXED, DCR_A(cpu, mem))
+OP(0x3e, FIXED, MVI_A(cpu, mem, IMM8))
+OP(0x3f, FIXED, CMC(cpu))
+OP(0x40, FIXED, MOV_B_B(cpu, mem))
+OP(0x41, FIXED, MOV_B_C(cpu, mem))
+OP(0x42, FIXED, MOV_B_D(cpu, mem))
+OP(0x43, FIXED, MOV_B_E(cpu, mem))
+OP(0x44, FIXED, MOV_B_H(cpu, mem))
+OP(0x45, FIXED, MOV_B_L(cpu, mem))
+OP(0x46, FIXED, MOV_B_M(cpu, mem))
+OP(0x47, FIXED, MOV_B_A(cpu, mem))
+OP(0x48, FIXED, MOV_C_B(cpu, mem))
+OP(0x49, FIXED, MOV_C_C(cpu, mem))
+OP(0x4a, FIXED, MOV_C_D(cpu, mem))
+OP(0x4b, FIXED, MOV_C_E(cpu, mem))
+OP(0x4c, FIXED, MOV_C_H(cpu, mem))
+OP(0x4d, FIXED, MOV_C_L(cpu, mem))
+OP(0x4e, FIXED, MOV_C_M(cpu, mem))
+OP(0x4f, FIXED, MOV_C_A(cpu, mem))
+OP(0x50, FIXED, MOV_D_B(cpu, mem))
+OP(0x51, FIXED, MOV_D_C(cpu, mem))
+OP(0x52, FIXED, MOV_D_D(cpu, mem))
+OP(0x53, FIXED, MOV_D_E(cpu, mem))
+OP(0x54, FIXED, MOV_D_H(cpu, mem))
+OP(0x55, FIXED, MOV_D_L(cpu, mem))
+OP(0x56, FIXED, MOV_D_M(cpu, mem))
+OP(0x57, FIXED, MOV_D_A(cpu, mem))
+OP(0x58, FIXED, MOV_E_B(cpu, mem))
+OP(0x59, FIXED, MOV_E_C(cpu, mem))
+OP(0x5a, FIXED, MOV_E_D(cpu, mem))
+OP(0x5b, FIXED, MOV_E_E(cpu, mem))
+OP(0x5c, FIXED, MOV_E_H(cpu, mem))
+OP(0x5d, FIXED, MOV_E_L(cpu, mem))
+OP(0x5e, FIXED, MOV_E_M(cpu, mem))
+OP(0x5f, FIXED, MOV_E_A(cpu, mem))
+OP(0x60, FIXED, MOV_H_B(cpu, mem))
+OP(0x61, FIXED, MOV_H_C(cpu, mem))
+OP(0x62, FIXED, MOV_H_D(cpu, mem))
+OP(0x63, FIXED, MOV_H_E(cpu, mem))
+OP(0x64, FIXED, MOV_H_H(cpu, mem))
+OP(0x65, FIXED, MOV_H_L(cpu, mem))
+OP(0x66, FIXED, MOV_H_M(cpu, mem))
+OP(0x67, FIXED, MOV_H_A(cpu, mem))
+OP(0x68, FIXED, MOV_L_B(cpu, mem))
+OP(0x69, FIXED, MOV_L_C(cpu, mem))
+OP(0x6a, FIXED, MOV_L_D(cpu, mem))
+OP(0x6b, FIXED, MOV_L_E(cpu, mem))
+OP(0x6c, FIXED, MOV_L_H(cpu, mem))
+OP(0x6d, FIXED, MOV_L_L(cpu, mem))
+OP(0x6e, FIXED, MOV_L_M(cpu, mem))
+OP(0x6f, FIXED, MOV_L_A(cpu, mem))
+OP(0x70, FIXED, MOV_M_B(cpu, mem))
+OP(0x71, FIXED, MOV_M_C(cpu, mem))
+OP(0x72, FIXED, MOV_M_D(cpu, mem))
+OP(0x73, FIXED, MOV_M_E(cpu, mem))
+OP(0x74, FIXED, MOV_M_H(cpu, mem))
+OP(0x75, FIXED, MOV_M_L(cpu, mem))
+OP(0x76, FIXED, HLT(cpu))
+OP(0x77, FIXED, MOV_M_A(cpu, mem))
+OP(0x78, FIXED, MOV_A_B(cpu, mem))
+OP(0x79, FIXED, MOV_A_C(cpu, mem))
+OP(0x7a, FIXED, MOV_A_D(cpu, mem))
+OP(0x7b, FIXED, MOV_A_E(cpu, mem))
+OP(0x7c, FIXED, MOV_A_H(cpu, mem))
+OP(0x7d, FIXED, MOV_A_L(cpu, mem))
+OP(0x7e, FIXED, MOV_A_M(cpu, mem))
+OP(0x7f, FIXED, MOV_A_A(cpu, mem))
+OP(0x80, FIXED, ADD_B(cpu, mem))
+OP(0x81, FIXED, ADD_C(cpu, mem))
+OP(0x82, FIXED, ADD_D(cpu, mem))
+OP(0x83, FIXED, ADD_E(cpu, mem))
+OP(0x84, FIXED, ADD_H(cpu, mem))
+OP(0x85, FIXED, ADD_L(cpu, mem))
+OP(0x86, FIXED, ADD_M(cpu, mem))
+OP(0x87, FIXED, ADD_A(cpu, mem))
+OP(0x88, FIXED, ADC_B(cpu, mem))
+OP(0x89, FIXED, ADC_C(cpu, mem))
+OP(0x8a, FIXED, ADC_D(cpu, mem))
+OP(0x8b, FIXED, ADC_E(cpu, mem))
+OP(0x8c, FIXED, ADC_H(cpu, mem))
+OP(0x8d, FIXED, ADC_L(cpu, mem))
+OP(0x8e, FIXED, ADC_M(cpu, mem))
+OP(0x8f, FIXED, ADC_A(cpu, mem))
+OP(0x90, FIXED, SUB_B(cpu, mem))
+OP(0x91, FIXED, SUB_C(cpu, mem))
+OP(0x92, FIXED, SUB_D(cpu, mem))
+OP(0x93, FIXED, SUB_E(cpu, mem))
+OP(0x94, FIXED, SUB_H(cpu, mem))
+OP(0x95, FIXED, SUB_L(cpu, mem))
+OP(0x96, FIXED, SUB_M(cpu, mem))
+OP(0x97, FIXED, SUB_A(cpu, mem))
+OP(0x98, FIXED, SBB_B(cpu, mem))
+OP(0x99, FIXED, SBB_C(cpu, mem))
+OP(0x9a, FIXED, SBB_D(cpu, mem))
+OP(0x9b, FIXED, SBB_E(cpu, mem))
+OP(0x9c, FIXED, SBB_H(cpu, mem))
+OP(0x9d, FIXED, SBB_L(cpu, mem))
+OP(0x9e, FIXED, SBB_M(cpu, mem))
+OP(0x9f, FIXED, SBB_A(cpu, mem))
+OP(0xa0, FIXED, ANA_B(cpu, mem))
+OP(0xa1, FIXED, ANA_C(cpu, mem))
+OP(0xa2, FIXED, ANA_D(cpu, mem))
+OP(0xa3, FIXED, ANA_E(cpu, mem))
+OP(0xa4, FIXED, ANA_H(cpu, mem))
+OP(0xa5, FIXED, ANA_L(cpu, mem))
+OP(0xa6, FIXED, ANA_M(cpu, mem))
+OP(0xa7, FIXED, ANA_A(cpu, mem))
+OP(0xa8, FIXED, XRA_B(cpu, mem))
+OP(0xa9, FIXED, XRA_C(cpu, mem))
+OP(0xaa, FIXED, XRA_D(cpu, mem))
+OP(0xab, FIXED, XRA_E(cpu, mem))
+OP(0xac, FIXED, XRA_H(cpu, mem))
+OP(0xad, FIXED, XRA_L(cpu, mem))
+OP(0xae, FIXED, XRA_M(cpu, mem))
+OP(0xaf, FIXED, XRA_A(cpu, mem))
+OP(0xb0, FIXED, ORA_B(cpu, mem))
+OP(0xb1, FIXED, ORA_C(cpu, mem))
+OP(0xb2, FIXED, ORA_D(cpu, mem))
+OP(0xb3, FIXED, ORA_E(cpu, mem))
+OP(0xb4, FIXED, ORA_H(cpu, mem))
+OP(0xb5, FIXED, ORA_L(cpu, mem))
+OP(0xb6, FIXED, ORA_M(cpu, mem))
+OP(0xb7, FIXED, ORA_A(cpu, mem))
+OP(0xb8, FIXED, CMP_B(cpu, mem))
+OP(0xb9, FIXED, CMP_C(cpu, mem))
+OP(0xba, FIXED, CMP_D(cpu, mem))
+OP(0xbb, FIXED, CMP_E(cpu, mem))
+OP(0xbc, FIXED, CMP_H(cpu, mem))
+OP(0xbd, FIXED, CMP_L(cpu, mem))
+OP(0xbe, FIXED, CMP_M(cpu, mem))
+OP(0xbf, FIXED, CMP_A(cpu, mem))
+OP(0xc0, TIMED, RNZ(cpu, mem))
+OP(0xc1, FIXED, POP_B(cpu, mem))
+OP(0xc2, FIXED, JNZ(cpu, IMM16))
+OP(0xc3, FIXED, JMP(cpu, IMM16))
+OP(0xc4, TIMED, CNZ(cpu, mem, IMM16))
+OP(0xc5, FIXED, PUSH_B(cpu, mem))
+OP(0xc6, FIXED, ADI(cpu, IMM8))
+OP(0xc7, FIXED, RST(cpu, mem, 0))
+OP(0xc8, TIMED, RZ(cpu, mem))
+OP(0xc9, FIXED, RET(cpu, mem))
+OP(0xca, FIXED, JZ(cpu, IMM16))
+OP(0xcc, TIMED, CZ(cpu, mem, IMM16))
+OP(0xcd, FIXED, CALL(cpu, mem, IMM16))
+OP(0xce, FIXED, ACI(cpu, IMM8))
+OP(0xcf, FIXED, RST(cpu, mem, 1))
+OP(0xd0, TIMED, RNC(cpu, mem))
+OP(0xd1, FIXED, POP_D(cpu, mem))
+OP(0xd2, FIXED, JNC(cpu, IMM16))
+OP(0xd3, FIXED, OUT(cpu, IMM8))
+OP(0xd4, TIMED, CNC(cpu, mem, IMM16))
+OP(0xd5, FIXED, PUSH_D(cpu, mem))
+OP(0xd6, FIXED, SUI(cpu, IMM8))
+OP(0xd7, FIXED, RST(cpu, mem, 2))
+OP(0xd8, TIMED, RC(cpu, mem))
+OP(0xda, FIXED, JC(cpu, IMM16))
+OP(0xdb, FIXED, IN(cpu, IMM8))
+OP(0xdc, TIMED, CC(cpu, mem, IMM16))
+OP(0xde, FIXED, SBI(cpu, IMM8))
+OP(0xdf, FIXED, RST(cpu, mem, 3))
+OP(0xe0, TIMED, RPO(cpu, mem))
+OP(0xe1, FIXED, POP_H(cpu, mem))
+OP(0xe2, FIXED, JPO(cpu, IMM16))
+OP(0xe3, FIXED, XTHL(cpu, mem))
+OP(0xe4, TIMED, CPO(cpu, mem, IMM16))
+OP(0xe5, FIXED, PUSH_H(cpu, mem))
+OP(0xe6, FIXED, ANI(cpu, IMM8))
+OP(0xe7, FIXED, RST(cpu, mem, 4))
+OP(0xe8, TIMED, RPE(cpu, mem))
+OP(0xe9, FIXED, PCHL(cpu))
+OP(0xea, FIXED, JPE(cpu, IMM16))
+OP(0xeb, FIXED, XCHG(cpu))
+OP(0xec, TIMED, CPE(cpu, mem, IMM16))
+OP(0xee, FIXED, XRI(cpu, IMM8))
+OP(0xef, FIXED, RST(cpu, mem, 5))
+OP(0xf0, TIMED, RP(cpu, mem))
+OP(0xf1, FIXED, POP_PSW(cpu, mem))
+OP(0xf2, FIXED, JP(cpu, IMM16))
+OP(0xf3, FIXED, DI(cpu, interrupts))
+OP(0xf4, TIMED, CP(cpu, mem, IMM16))
+OP(0xf5, FIXED, PUSH_PSW(cpu, mem))
+OP(0xf6, FIXED, ORI(cpu, IMM8))
+OP(0xf7, FIXED, RST(cpu, mem, 6))
+OP(0xf8, TIMED, RM(cpu, mem))
+OP(0xf9, FIXED, SPHL(cpu))
+OP(0xfa, FIXED, JM(cpu, IMM16))
+OP(0xfb, FIXED, EI(cpu, interrupts))
+OP(0xfc, TIMED, CM(cpu, mem, IMM16))
+OP(0xfe, FIXED, CPI(cpu, IMM8))
+OP(0xff, FIXED, RST(cpu, mem, 7))
+
+#undef OP
@@ -0,0 +1,389 @@
+/* The length and cycle count of every 8080 opcode.
+ * Kept apart from the rest of the CPU so that spinv_recompile can link the same tables the interpreter decodes with, without the CPU itself.
+ */
+
+#include "cpu8080.h"
+
+void initializeOpLengths(uint8_t *lengths) {
+	int i;
+	for(i = 0; i < NUM_OF_OPCODES; ++i) {
+		lengths[i] = 1;
+	}
+	lengths[0x01] =  3;
+	lengths[0x06] = 2;
+	lengths[0x0e] = 2;
+	lengths[0x11] =  3;
+	lengths[0x16] = 2;
+	lengths[0x1e] = 2;
+	lengths[0x21] =  3;
+	lengths[0x22] =  3;
+	lengths[0x26] = 2;
+	lengths[0x2a] =  3;
+	lengths[0x2e] = 2;
+	lengths[0x31] =  3;
+	lengths[0x32] =  3;
+	lengths[0x36] = 2;
+	lengths[0x3a] =  3;
+	lengths[0x3e] = 2;
+	lengths[0xc2] =  3;
+	lengths[0xc3] =  3;
+	lengths[0xc4] =  3;
+	lengths[0xc6] = 2;
+	lengths[0xca] =  3;
+	lengths[0xcc] =  3;
+	lengths[0xcd] =  3;
+	lengths[0xce] = 2;
+	lengths[0xd2] =  3;
+	lengths[0xd3] = 2;
+	lengths[0xd4] =  3;
+	lengths[0xd6] = 2;
+	lengths[0xda] =  3;
+	lengths[0xdb] = 2;
+	lengths[0xdc] =  3;
+	lengths[0xde] = 2;
+	lengths[0xe2] =  3;
+	lengths[0xe4] =  3;
+	lengths[0xe6] = 2;
+	lengths[0xea] =  3;
+	lengths[0xec] =  3;
+	lengths[0xee] = 2;
+	lengths[0xf2] =  3;
+	lengths[0xf4] =  3;
+	lengths[0xf6] = 2;
+	lengths[0xfa] =  3;
+	lengths[0xfc] =  3;
+	lengths[0xfe] = 2;
+}
+
+void initializeOpCycles(uint8_t *cycles) {
+	int i;
+	for(i = 0; i < NUM_OF_OPCODES; ++i) {
+		cycles[i] = 255; // a placeholder value. Check for it in the CPU loop, if you see it, you done fucked up
+	}
+	// NOP
+	cycles[0x00] = 4;
+	// MVI
+	cycles[0x06] =  7;
+	cycles[0x0e] =  7;
+	cycles[0x16] =  7;
+	cycles[0x1e] =  7;
+	cycles[0x26] =  7;
+	cycles[0x2e] =  7;
+	cycles[0x36] =   10;
+	cycles[0x3e] =  7;
+	// LXI
+	cycles[0x01] =   10;
+	cycles[0x11] =   10;
+	cycles[0x21] =   10;
+	cycles[0x31] =   10;
+	// INR
+	cycles[0x04] = 5;
+	cycles[0x0c] = 5;
+	cycles[0x14] = 5;
+	cycles[0x1c] = 5;
+	cycles[0x24] = 5;
+	cycles[0x2c] = 5;
+	cycles[0x34] =   10;
+	cycles[0x3c] = 5;
+	// DCR
+	cycles[0x05] = 5;
+	cycles[0x0d] = 5;
+	cycles[0x15] = 5;
+	cycles[0x1d] = 5;
+	cycles[0x25] = 5;
+	cycles[0x2d] = 5;
+	cycles[0x35] =   10;
+	cycles[0x3d] = 5;
+	// INX
+	cycles[0x03] = 5;
+	cycles[0x13] = 5;
+	cycles[0x23] = 5;
+	cycles[0x33] = 5;
+	// DCX
+	cycles[0x0b] = 5;
+	cycles[0x1b] = 5;
+	cycles[0x2b] = 5;
+	cycles[0x3b] = 5;
+	// DAD
+	cycles[0x09] =   10;
+	cycles[0x19] =   10;
+	cycles[0x29] =   10;
+	cycles[0x39] =   10;
+	// ADI
+	cycles[0xc6] =  7;
+	// SUI
+	cycles[0xd6] =  7;
+	// ACI
+	cycles[0xce] =  7;
+	// SBI
+	cycles[0xde] =  7;
+	// CPI
+	cycles[0xfe] =  7;
+	// ANI
+	cycles[0xe6] =  7;
+	// ORI
+	cycles[0xf6] =  7;
+	// XRI
+	cycles[0xee] =  7;
+	// MOV
+	cycles[0x40] = 5;
+	cycles[0x41] = 5;
+	cycles[0x42] = 5;
+	cycles[0x43] = 5;
+	cycles[0x44] = 5;
+	cycles[0x45] = 5;
+	cycles[0x46] =  7;
+	cycles[0x47] = 5;
+	cycles[0x48] = 5;
+	cycles[0x49] = 5;
+	cycles[0x4a] = 5;
+	cycles[0x4b] = 5;
+	cycles[0x4c] = 5;
+	cycles[0x4d] = 5;
+	cycles[0x4e] =  7;
+	cycles[0x4f] = 5;
+	cycles[0x50] = 5;
+	cycles[0x51] = 5;
+	cycles[0x52] = 5;
+	cycles[0x53] = 5;
+	cycles[0x54] = 5;
+	cycles[0x55] = 5;
+	cycles[0x56] =  7;
+	cycles[0x57] = 5;
+	cycles[0x58] = 5;
+	cycles[0x59] = 5;
+	cycles[0x5a] = 5;
+	cycles[0x5b] = 5;
+	cycles[0x5c] = 5;
+	cycles[0x5d] = 5;
+	cycles[0x5e] =  7;
+	cycles[0x5f] = 5;
+	cycles[0x60] = 5;
+	cycles[0x61] = 5;
+	cycles[0x62] = 5;
+	cycles[0x63] = 5;
+	cycles[0x64] = 5;
+	cycles[0x65] = 5;
+	cycles[0x66] =  7;
+	cycles[0x67] = 5;
+	cycles[0x68] = 5;
+	cycles[0x69] = 5;
+	cycles[0x6a] = 5;
+	cycles[0x6b] = 5;
+	cycles[0x6c] = 5;
+	cycles[0x6d] = 5;
+	cycles[0x6e] =  7;
+	cycles[0x6f] = 5;
+	cycles[0x70] =  7;
+	cycles[0x71] =  7;
+	cycles[0x72] =  7;
+	cycles[0x73] =  7;
+	cycles[0x74] =  7;
+	cycles[0x75] =  7;
+	cycles[0x77] =  7;
+	cycles[0x78] = 5;
+	cycles[0x79] = 5;
+	cycles[0x7a] = 5;
+	cycles[0x7b] = 5;
+	cycles[0x7c] = 5;
+	cycles[0x7d] = 5;
+	cycles[0x7e] =  7;
+	cycles[0x7f] = 5;
+	// ADD
+	cycles[0x80] = 4;
+	cycles[0x81] = 4;
+	cycles[0x82] = 4;
+	cycles[0x83] = 4;
+	cycles[0x84] = 4;
+	cycles[0x85] = 4;
+	cycles[0x86] =  7;
+	cycles[0x87] = 4;
+	// SUB
+	cycles[0x90] = 4;
+	cycles[0x91] = 4;
+	cycles[0x92] = 4;
+	cycles[0x93] = 4;
+	cycles[0x94] = 4;
+	cycles[0x95] = 4;
+	cycles[0x96] =  7;
+	cycles[0x97] = 4;
+	// ADC
+	cycles[0x88] = 4;
+	cycles[0x89] = 4;
+	cycles[0x8a] = 4;
+	cycles[0x8b] = 4;
+	cycles[0x8c] = 4;
+	cycles[0x8d] = 4;
+	cycles[0x8e] =  7;
+	cycles[0x8f] = 4;
+	// SBB
+	cycles[0x98] = 4;
+	cycles[0x99] = 4;
+	cycles[0x9a] = 4;
+	cycles[0x9b] = 4;
+	cycles[0x9c] = 4;
+	cycles[0x9d] = 4;
+	cycles[0x9e] =  7;
+	cycles[0x9f] = 4;
+	// CMP
+	cycles[0xb8] = 4;
+	cycles[0xb9] = 4;
+	cycles[0xba] = 4;
+	cycles[0xbb] = 4;
+	cycles[0xbc] = 4;
+	cycles[0xbd] = 4;
+	cycles[0xbe] =  7;
+	cycles[0xbf] = 4;
+	// ANA
+	cycles[0xa0] = 4;
+	cycles[0xa1] = 4;
+	cycles[0xa2] = 4;
+	cycles[0xa3] = 4;
+	cycles[0xa4] = 4;
+	cycles[0xa5] = 4;
+	cycles[0xa6] =  7;
+	cycles[0xa7] = 4;
+	// ORA
+	cycles[0xb0] = 4;
+	cycles[0xb1] = 4;
+	cycles[0xb2] = 4;
+	cycles[0xb3] = 4;
+	cycles[0xb4] = 4;
+	cycles[0xb5] = 4;
+	cycles[0xb6] =  7;
+	cycles[0xb7] = 4;
+	// XRA
+	cycles[0xa8] = 4;
+	cycles[0xa9] = 4;
+	cycles[0xaa] = 4;
+	cycles[0xab] = 4;
+	cycles[0xac] = 4;
+	cycles[0xad] = 4;
+	cycles[0xae] =  7;
+	cycles[0xaf] = 4;
+	// CMA
+	cycles[0x2f] = 4;
+	// RLC
+	cycles[0x07] = 4;
+	// RRC
+	cycles[0x0f] = 4;
+	// RAL
+	cycles[0x17] = 4;
+	// RAR
+	cycles[0x1f] = 4;
+	// PUSH
+	cycles[0xc5] =   11;
+	cycles[0xd5] =   11;
+	cycles[0xe5] =   11;
+	cycles[0xf5] =   11;
+	// POP
+	cycles[0xc1] =   10;
+	cycles[0xd1] =   10;
+	cycles[0xe1] =   10;
+	cycles[0xf1] =   10;
+	// STA
+	cycles[0x32] =    13;
+	// LDA
+	cycles[0x3a] =    13;
+	// STAX
+	cycles[0x02] =  7;
+	cycles[0x12] =  7;
+	// LDAX
+	cycles[0x0a] =  7;
+	cycles[0x1a] =  7;
+	// JMP
+	cycles[0xc3] =   10;
+	// JZ
+	cycles[0xca] =   10;
+	// JNZ
+	cycles[0xc2] =   10;
+	// JM
+	cycles[0xfa] =   10;
+	// JP
+	cycles[0xf2] =   10;
+	// JPE
+	cycles[0xea] =   10;
+	// JPO
+	cycles[0xe2] =   10;
+	// JC
+	cycles[0xda] =   10;
+	// JNC
+	cycles[0xd2] =   10;
+	// CALL
+	cycles[0xcd] =     17;
+	// CZ
+	cycles[0xcc] =     17; // 11 if zero bit not set. the handler returns the exact count
+	// CNZ
+	cycles[0xc4] =     17; // 11 if zero bit set. the handler returns the exact count
+	// CM
+	cycles[0xfc] =     17; // 11 if sign bit not set. the handler returns the exact count
+	// CP
+	cycles[0xf4] =     17; // 11 if sign bit set. the handler returns the exact count
+	// CPE
+	cycles[0xec] =     17; // 11 if parity bit not set. the handler returns the exact count
+	// CPO
+	cycles[0xe4] =     17; // 11 if parity bit set. the handler returns the exact count
+	// CC
+	cycles[0xdc] =     17; // 11 if carry bit not set. the handler returns the exact count
+	// CNC
+	cycles[0xd4] =     17; // 11 if carry bit set. the handler returns the exact count
+	// RET
+	cycles[0xc9] =   10;
+	// RZ
+	cycles[0xc8] =   11; // 5 if zero bit not set. the handler returns the exact count
+	// RNZ
+	cycles[0xc0] =   11; // 5 if zero bit set. the handler returns the exact count
+	// RM
+	cycles[0xf8] =   11; // 5 if sign bit not set. the handler returns the exact count
+	// RP
+	cycles[0xf0] =   11; // 5 if sign bit set. the handler returns the exact count
+	// RPE
+	cycles[0xe8] =   11; // 5 if parity bit not set. the handler returns the exact count
+	// RPO
+	cycles[0xe0] =   11; // 5 if parity bit set. the handler returns the exact count
+	// RC
+	cycles[0xd8] =   11; // 5 if carry bit not set. the handler returns the exact count
+	// RNC
+	cycles[0xd0] =   11; // 5 if carry bit set. the handler returns the exact count
+	// RST
+	cycles[0xc7] =   11;
+	cycles[0xcf] =   11;
+	cycles[0xd7] =   11;
+	cycles[0xdf] =   11;
+	cycles[0xe7] =   11;
+	cycles[0xef] =   11;
+	cycles[0xf7] =   11;
+	cycles[0xff] =   11;
+	// SHLD
+	cycles[0x22] =     16;
+	// LHLD
+	cycles[0x2a] =     16;
+	// XTHL
+	cycles[0xe3] =     18;
+	// XCHG
+	cycles[0xeb] = 4;
+	// SPHL
+	cycles[0xf9] = 5;
+	// PCHL
+	cycles[0xe9] = 5;
+	// STC
+	cycles[0x37] = 4;
+	// CMC
+	cycles[0x3f] = 4;
+	// DAA
+	cycles[0x27] = 4;
+	// IN
+	cycles[0xdb] =   10;
+	// OUT
+	cycles[0xd3] =   10;
+	// RIM
+	cycles[0x20] = 4;
+	// SIM
+	cycles[0x30] = 4;
+	// DI
+	cycles[0xf3] = 4;
+	// EI
+	cycles[0xfb] = 4;
+	// HLT
+	cycles[0x76] =  7;
+}
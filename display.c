@@ -1,6 +1,9 @@
 #include "display.h"
-#include "controls.h"
+#include "keyboard.h"
+#include "render.h"
+#include "present.h"
 
+#include <gtk/gtk.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -11,36 +14,84 @@
 typedef struct {
 	GtkWidget *screen;
 	uint8_t *memory;
-	Interrupt *interrupts;
+	Renderer *renderer;
+	unsigned long image_shown; /* the number of the frame whose image is being shown */
 } RefreshData;
 
+/* the image being shown, coloured and scaled up to the window by presenter. It is only made again when the scale changes */
 static cairo_surface_t *surface = NULL;
+static Presenter presenter;
 /* this data must be global because it must remain available for the screen refresh callback after the activate function exits, but it cannot be initialized outside of the activate function (I believe) */
 static guint timeout_id;
 static RefreshData refresh_data;
+static GtkApplication *app;
 
 static gdouble display_scale;
 
-static gboolean configure_event(GtkWidget *widget, GdkEventConfigure *event, gpointer data) {
+/* Draws the given blocks of the image being shown onto surface, and has the strips of the screen they cover drawn again, in as few
+ * rectangles as they make up. */
+static void present_blocks(RefreshData *rd, uint32_t blocks) {
+	Renderer *renderer = rd->renderer;
+	int scale = presenter.scale;
+
+	/* Flush all pending operations */
+	cairo_surface_flush(surface);
+	present_image(&presenter, renderer->images[renderer->buffer.front].pixels, (uint32_t *)cairo_image_surface_get_data(surface),
+			cairo_image_surface_get_stride(surface), blocks);
+
+	int block = 0;
+	while(block < ROTATION_BLOCKS) {
+		if(!(blocks & (1u << block))) {
+			++block;
+			continue;
+		}
+		int first = block;
+		while(block < ROTATION_BLOCKS && (blocks & (1u << block))) {
+			++block;
+		}
+		cairo_surface_mark_dirty_rectangle(surface, first * 8 * scale, 0, (block - first) * 8 * scale, PRESENT_HEIGHT * scale);
+		gtk_widget_queue_draw_area(rd->screen, first * 8 * scale, 0, (block - first) * 8 * scale, PRESENT_HEIGHT * scale);
+	}
+}
+
+/* Makes surface again at the largest whole scale that fits the window, if that has changed, and draws the image being shown onto it. */
+static void scale_surface(RefreshData *rd) {
+	int scale = (int)display_scale;
+	if(scale < 1) {
+		scale = 1;
+	}
+	if(surface != NULL && scale == presenter.scale) {
+		return;
+	}
+	if(set_presenter_scale(&presenter, scale) != 0) {
+		fprintf(stderr, "WARNING: Unable to scale the display by %d, staying at %d.\n", scale, presenter.scale);
+		if(surface != NULL) {
+			return;
+		}
+	}
+
 	if(surface) {
 		cairo_surface_destroy(surface);
 	}
+	surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, PRESENT_WIDTH * presenter.scale, PRESENT_HEIGHT * presenter.scale);
+	present_blocks(rd, ROTATION_ALL_BLOCKS);
+}
 
+static gboolean configure_event(GtkWidget *widget, GdkEventConfigure *event, gpointer data) {
 	/* WIDTH and HEIGHT are reversed here, since the display is rotated 90 degrees in the cabinet */
 	gdouble xscale = ((gdouble)event->width)/DISPLAY_HEIGHT;
 	gdouble yscale = ((gdouble)event->height)/DISPLAY_WIDTH;
 	display_scale = xscale < yscale ? xscale : yscale;
 
-	//surface = gdk_window_create_similar_surface(gtk_widget_get_window(widget), CAIRO_CONTENT_COLOR, DISPLAY_HEIGHT * display_scale, DISPLAY_WIDTH * display_scale);
-	/* setting scale to 0 should cause the surface to inherit the window's scale. */
-	surface = gdk_window_create_similar_image_surface(gtk_widget_get_window(widget), CAIRO_FORMAT_A1, DISPLAY_HEIGHT, DISPLAY_WIDTH, 0);
-
-	//fprintf(stdout, "Width: %d | Height: %d | Stride: %d\n", cairo_image_surface_get_width(surface), cairo_image_surface_get_height(surface), cairo_image_surface_get_stride(surface));
+	scale_surface(&refresh_data);
 
 	return TRUE;
 }
 
 static gboolean draw(GtkWidget *widget, cairo_t *cr, gpointer data) {
+	/* the cabinet is black around the screen, wherever the window is too big for a whole scale */
+	cairo_set_source_rgb(cr, 0, 0, 0);
+	cairo_paint(cr);
 	cairo_set_source_surface(cr, surface, 0, 0);
 	cairo_paint(cr);
 
@@ -103,11 +154,9 @@ static gboolean legacy_refresh(gpointer data) {
 
 	if(draw_side == DRAW_TOP) {
 		draw_side = DRAW_BOTTOM;
-		trigger_hblank(rd->interrupts);
 	}
 	else { /* draw_side == DRAW_BOTTOM */
 		draw_side = DRAW_TOP;
-		trigger_vblank(rd->interrupts);
 	}
 
 	gtk_widget_queue_draw(rd->screen);
@@ -116,43 +165,22 @@ static gboolean legacy_refresh(gpointer data) {
 	return TRUE; /* do not cancel the timeout */
 }
 
+/* Switches to the newest image the render thread has finished, if there is one that has not been shown yet. Interrupts are raised by the CPU
+ * thread itself, so this only has to keep up with the frames, not set their pace. Only the strips of the screen that differ from the image
+ * shown before are drawn again. */
 static gboolean refresh(gpointer data) {
 	RefreshData *rd = (RefreshData *)data;
+	Renderer *renderer = rd->renderer;
 
-	static int draw_side = DRAW_TOP;
-
-	if(draw_side == DRAW_BOTTOM) {
-		/* Flush all pending operations */
-		cairo_surface_flush(surface);
-		/* Copy VRAM to pixel buffer */
-		uint8_t *image_data = cairo_image_surface_get_data(surface);
-		//memcpy(image_data, &rd->memory[VRAM_START_ADDRESS], 0x1c00); /* doesn't work because the screen has to be rotated */
-		/* TODO: get rid of junk on the side of the screen */
-		int i, r;
-		for(i = 0; i < DISPLAY_WIDTH * DISPLAY_HEIGHT; i++) {
-			uint8_t reassembled_byte = 0;
-			int row = (i % 28) * 8;
-			int col = 0x100 - (i / 224) - 1;
-			int bit = 7 - ((i / 28) % 8);
-			//fprintf(stdout, "Cell %d, data from row %d col %d bit %d\n", i, row, col, bit);
-			for(r = 0; r < 8; r++) {
-				reassembled_byte |= ((rd->memory[VRAM_START_ADDRESS + (row + r)*0x20 + col] & (0x01 << bit)) >> bit) << r;
-			}
-			image_data[i] = ~reassembled_byte;
-		}
-		/* Indicate that pixel buffer has been altered */
-		cairo_surface_mark_dirty(surface);
+	if(!take_triple_buffer(&renderer->buffer)) {
+		return TRUE;
 	}
 
-	if(draw_side == DRAW_TOP) {
-		draw_side = DRAW_BOTTOM;
-		trigger_hblank(rd->interrupts);
-	}
-	else { /* draw_side == DRAW_BOTTOM */
-		draw_side = DRAW_TOP;
-		trigger_vblank(rd->interrupts);
-		gtk_widget_queue_draw(rd->screen);
-	}
+	Image *image = &renderer->images[renderer->buffer.front];
+	uint32_t blocks = image->number == rd->image_shown + 1 ? image->blocks : ROTATION_ALL_BLOCKS;
+	rd->image_shown = image->number;
+
+	present_blocks(rd, blocks);
 
 	return TRUE; /* do not cancel the timeout */
 }
@@ -160,6 +188,7 @@ static gboolean refresh(gpointer data) {
 static void close_window() {
 	if(surface) {
 		cairo_surface_destroy(surface);
+		surface = NULL;
 	}
 }
 
@@ -181,6 +210,8 @@ static void activate(GtkApplication *app, gpointer user_data) {
 	gtk_widget_set_size_request(game_screen, DISPLAY_HEIGHT, DISPLAY_WIDTH);
 	gtk_container_add(GTK_CONTAINER(window), game_screen);
 	display_scale = 1.0; /* initial window scale is 1:1 with original Space Invaders display */
+	refresh_data.screen = game_screen;
+	scale_surface(&refresh_data);
 
 	g_signal_connect(game_screen, "draw", G_CALLBACK(draw), NULL);
 	g_signal_connect(game_screen, "configure_event", G_CALLBACK(configure_event), NULL);
@@ -189,25 +220,43 @@ static void activate(GtkApplication *app, gpointer user_data) {
 
 	gtk_widget_show_all(window);
 
-	/* set a timeout to check memory a draw the screen 60 times per second (actually 120, top half -> hblank, bottom half -> vblank) */
-	refresh_data.screen = game_screen;
+	/* set a timeout to check for a new image 120 times per second, twice as often as they come, so that none waits long to be shown */
 	refresh_data.memory = game_state->memory;
-	refresh_data.interrupts = game_state->interrupts;
+	refresh_data.image_shown = 0;
 	guint interval = (guint)((1.0/120.0)*1000); /* interval is given in terms of milliseconds */
 	timeout_id = g_timeout_add(interval, refresh, &refresh_data);
 }
 
-void init_display(GtkApplication **app, GameState *game_state) {
-	*app = gtk_application_new("spinvemu.emulator", G_APPLICATION_FLAGS_NONE);
-	g_signal_connect(*app, "activate", G_CALLBACK(activate), game_state);
+int init_display(GameState *game_state, Renderer *renderer) {
+	if(renderer == NULL) {
+		return -1; /* there would be nothing to show */
+	}
+	if(initialize_presenter(&presenter, 1) != 0) {
+		return -1;
+	}
+	refresh_data.renderer = renderer;
+
+	app = gtk_application_new("spinvemu.emulator", G_APPLICATION_FLAGS_NONE);
+	g_signal_connect(app, "activate", G_CALLBACK(activate), game_state);
+	return 0;
 }
 
-int run_display(GtkApplication *app, int argc, char **argv) {
+int run_display(int argc, char **argv) {
 	int status = g_application_run(G_APPLICATION(app), 1, argv); /* The application doesn't really need to know any command-line arguments, and complains if there's a file name present and it doesn't have the HANDLES_OPEN flag set. But it also gets mad if we don't give it anything */
 	return status;
 }
 
-void close_display(GtkApplication *app) {
+static gboolean quit_application(gpointer data) {
+	g_application_quit(G_APPLICATION(app));
+	return FALSE; /* only once */
+}
+
+void quit_display() {
+	g_idle_add(quit_application, NULL); /* g_idle_add() is safe from any thread. the quit itself happens on the main thread */
+}
+
+void close_display() {
 	g_source_remove(timeout_id);
 	g_object_unref(app);
+	destroy_presenter(&presenter);
 }
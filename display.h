@@ -2,20 +2,27 @@
 #define SPINV_DISPLAY
 
 #include "emulator.h"
-
-#include <gtk/gtk.h>
+#include "render.h"
 
 /* screen is rotated 90 degrees CCW, so it's actually 224*256 */
 #define DISPLAY_WIDTH  256
 #define DISPLAY_HEIGHT 224
-#define VRAM_START_ADDRESS 0x2400 /* VRAM goes from 0x2400-3FFF, each bit mapping to one pixel */
 
-/* prepares the display object for drawing. Call once before making any other calls to the display. */
-void init_display(GtkApplication **app, GameState *game_state);
+/* The display backend shows the frames and takes in the controls. Each program links in exactly one: spinv_emulator the GTK window in display.c,
+ * and spinv_headless the one in headless.c, which needs no display, and no GTK, at all. Only quit_display() may be called from other threads
+ * than the main one. */
+
+/* prepares the display object for drawing the images renderer makes. renderer is NULL when nothing is being rendered, which only the headless
+ * backend can do without. Call once before making any other calls to the display. Returns 0 on success */
+int init_display(GameState *game_state, Renderer *renderer);
+
+/* runs the display until it is closed, or quit_display() is called, and returns the exit status */
+int run_display(int argc, char **argv);
 
-int run_display(GtkApplication *app, int argc, char **argv);
+/* makes run_display() return as soon as it can. Safe to call from any thread, and before run_display() has started. */
+void quit_display();
 
 /* frees the memory associated with the display object. Use as part of cleanup. */
-void close_display(GtkApplication *app);
+void close_display();
 
 #endif
@@ -5,6 +5,7 @@
 
 #include "emulator.h"
 #include "display.h"
+#include "render.h"
 #include "ports.h"
 
 #include <stdlib.h>
@@ -14,15 +15,112 @@
 #include <errno.h>
 
 #define EXIT_IO_ERROR 3
+#define EXIT_USAGE_ERROR 2
+
+#define CYCLES_PER_HALF_FRAME (CYCLES_PER_SECOND / 120) /* the screen is drawn 60 times a second, with an interrupt halfway down and another at the bottom */
 
 void *emulate_cpu(void *state);
+void finish_frame(GameState *game_state);
 
 void help(char *program_name) {
-	fprintf(stdout, "Usage: %s <filename>\n", program_name);
+	fprintf(stdout, "Usage: %s [options] <filename>\n", program_name);
+	fprintf(stdout, "Options:\n");
+	fprintf(stdout, "  --speed <factor>  run <factor> times as fast as the real machine (default 1)\n");
+	fprintf(stdout, "  --unthrottled     run as fast as the host allows\n");
+	fprintf(stdout, "  --pacing <mode>   how to wait for real time to catch up: sleep (default), timerfd to wait on a timer through epoll, or\n");
+	fprintf(stdout, "                    hybrid to sleep most of the way and spin the rest, for the least jitter\n");
+	fprintf(stdout, "  --pacing-stats    print how well frame deadlines were kept, and how long inputs took to reach the game, once a\n");
+	fprintf(stdout, "                    second\n");
+	fprintf(stdout, "  --frames <count>  stop after <count> frames\n");
+	fprintf(stdout, "  --record-inputs <file>\n");
+	fprintf(stdout, "                    write every input to <file>, along with the cycle it reached the game on\n");
+	fprintf(stdout, "  --replay-inputs <file>\n");
+	fprintf(stdout, "                    apply the inputs recorded in <file> on the cycles they were recorded on, instead of the controls\n");
+	fprintf(stdout, "  --no-render       do not draw the frames at all. only spinv_headless can run like this\n");
 }
 
 int main(int argc, char **argv) {
-	if(argc < 2) {
+	/*
+	 * ----- READ OPTIONS -----
+	 */
+
+	char *filename = NULL;
+	double speed = 1.0; /* 0 means unthrottled */
+	PacingMode pacing_mode = PACING_SLEEP;
+	int print_pacing_stats = 0;
+	unsigned long frame_limit = 0; /* 0 means no limit */
+	char *record_filename = NULL;
+	char *replay_filename = NULL;
+	int render = 1;
+	int arg;
+	for(arg = 1; arg < argc; ++arg) {
+		if(strcmp(argv[arg], "--speed") == 0) {
+			char *end = NULL;
+			if(arg + 1 < argc) {
+				speed = strtod(argv[++arg], &end);
+			}
+			if(end == NULL || *end != '\0' || end == argv[arg] || !(speed > 0)) {
+				fprintf(stderr, "ERROR: --speed needs a factor greater than 0\n");
+				return EXIT_USAGE_ERROR;
+			}
+		}
+		else if(strcmp(argv[arg], "--unthrottled") == 0) {
+			speed = 0;
+		}
+		else if(strcmp(argv[arg], "--pacing") == 0) {
+			char *mode = arg + 1 < argc ? argv[++arg] : "";
+			if(strcmp(mode, "sleep") == 0) {
+				pacing_mode = PACING_SLEEP;
+			}
+			else if(strcmp(mode, "timerfd") == 0) {
+				pacing_mode = PACING_TIMERFD;
+			}
+			else if(strcmp(mode, "hybrid") == 0) {
+				pacing_mode = PACING_HYBRID;
+			}
+			else {
+				fprintf(stderr, "ERROR: --pacing needs one of sleep, timerfd or hybrid\n");
+				return EXIT_USAGE_ERROR;
+			}
+		}
+		else if(strcmp(argv[arg], "--pacing-stats") == 0) {
+			print_pacing_stats = 1;
+		}
+		else if(strcmp(argv[arg], "--frames") == 0) {
+			char *end = NULL;
+			if(arg + 1 < argc) {
+				frame_limit = strtoul(argv[++arg], &end, 10);
+			}
+			if(end == NULL || *end != '\0' || end == argv[arg] || frame_limit == 0) {
+				fprintf(stderr, "ERROR: --frames needs a count greater than 0\n");
+				return EXIT_USAGE_ERROR;
+			}
+		}
+		else if(strcmp(argv[arg], "--record-inputs") == 0 || strcmp(argv[arg], "--replay-inputs") == 0) {
+			if(arg + 1 >= argc) {
+				fprintf(stderr, "ERROR: %s needs a file\n", argv[arg]);
+				return EXIT_USAGE_ERROR;
+			}
+			if(strcmp(argv[arg], "--record-inputs") == 0) {
+				record_filename = argv[++arg];
+			}
+			else {
+				replay_filename = argv[++arg];
+			}
+		}
+		else if(strcmp(argv[arg], "--no-render") == 0) {
+			render = 0;
+		}
+		else if(filename == NULL && strncmp(argv[arg], "--", 2) != 0) {
+			filename = argv[arg];
+		}
+		else {
+			help(argv[0]);
+			return EXIT_USAGE_ERROR;
+		}
+	}
+
+	if(filename == NULL) {
 		help(argv[0]);
 		return EXIT_SUCCESS;
 	}
@@ -35,7 +133,6 @@ int main(int argc, char **argv) {
 	int success;
 
 	/* Open file */
-	char *filename = argv[1];
 	FILE *file = fopen(filename, "rb");
 	if(file == NULL) {
 		fprintf(stderr, "ERROR: unable to open file %s\n%s\n", filename, strerror(errno));
@@ -53,7 +150,7 @@ int main(int argc, char **argv) {
 	 * TODO: RAM Mirror: $4000-$7fff
 	 *   implementing this will require abstracting writes to memory into its own function, which would probably be a good thing for thread-safety anyway
 	 */
-	uint8_t *memory = calloc(0x4000, sizeof(uint8_t));
+	uint8_t *memory = calloc(MEMORY_SIZE, sizeof(uint8_t));
 
 	size_t bytes_read = fread(memory, sizeof(uint8_t), size, file);
 
@@ -83,15 +180,36 @@ int main(int argc, char **argv) {
 
 	/* initialize controls */
 	GameControl *game_control = malloc(sizeof(GameControl));
-	init_game_control(game_control);
+	init_game_control(game_control, print_pacing_stats);
+	if((record_filename != NULL && record_inputs(game_control, record_filename) != 0) ||
+	   (replay_filename != NULL && replay_inputs(game_control, replay_filename) != 0)) {
+		return EXIT_IO_ERROR;
+	}
 	init_ports(game_control);
 	set_control_debug_memory_pointer(memory);
 
+	/* initialize the frames handed from the CPU thread to the render thread, unless there is nothing to render them */
+	FrameQueue *frames = NULL;
+	if(render) {
+		frames = malloc(sizeof(FrameQueue));
+		memset(frames->frames, 0, sizeof(frames->frames));
+		initialize_triple_buffer(&frames->buffer);
+		sem_init(&frames->ready, 0, 0); /* TODO: check for failure */
+		frames->finished = 0;
+	}
+
 	GameState *game_state = malloc(sizeof(GameState));
 	game_state->cpu = cpu;
 	game_state->memory = memory;
 	game_state->interrupts = interrupts;
 	game_state->game_control = game_control;
+	game_state->frames = frames;
+	game_state->frame_limit = frame_limit;
+
+	/* initialize pacing. the CPU thread does the waiting, but the main thread needs to be able to wake it when it is time to exit */
+	Pacer *pacer = malloc(sizeof(Pacer));
+	initialize_pacer(pacer, pacing_mode, speed, print_pacing_stats);
+	game_state->pacer = pacer;
 
 	/* initialize thread synchronization variables */
 	sem_t *thread_sync = malloc(sizeof(sem_t));
@@ -101,9 +219,23 @@ int main(int argc, char **argv) {
 	*thread_exit = 0;
 	game_state->thread_exit = thread_exit;
 
+	/* initialize render thread, which turns each frame upright for the display */
+	Renderer *renderer = NULL;
+	if(render) {
+		renderer = malloc(sizeof(Renderer));
+		success = start_renderer(renderer, frames);
+		if(success != 0) {
+			fprintf(stderr, "ERROR: Unable to create render thread.");
+			return EXIT_FAILURE;
+		}
+	}
+
 	/* Initialize display */
-	GtkApplication *app;
-	init_display(&app, game_state);
+	success = init_display(game_state, renderer);
+	if(success != 0) {
+		fprintf(stderr, render ? "ERROR: Unable to initialize display.\n" : "ERROR: This display cannot run with --no-render.\n");
+		return EXIT_FAILURE;
+	}
 
 	/* initialize CPU thread */
 	pthread_t cpu_thread;
@@ -124,13 +256,14 @@ int main(int argc, char **argv) {
 	
 	sem_post(game_state->thread_sync); /* TODO: check for failure */
 
-	int status = run_display(app, argc, argv);
+	int status = run_display(argc, argv);
 
 	/*
 	 * ----- CLEAN UP RESOURCES -----
 	 */
 
 	*game_state->thread_exit = 1;
+	wake_pacer(pacer);
 
 	void *cpu_success;
 	success = pthread_join(cpu_thread, &cpu_success);
@@ -140,7 +273,10 @@ int main(int argc, char **argv) {
 	}
 	/* TODO: check the value of cpu_success? maybe just set to NULL */
 
-	close_display(app);
+	if(renderer != NULL) {
+		stop_renderer(renderer);
+	}
+	close_display();
 
 	destroy_game_control(game_control);
 	destroy_interrupts(interrupts);
@@ -149,33 +285,66 @@ int main(int argc, char **argv) {
 	free(thread_sync);
 	free(game_state);
 	free(game_control);
+	free(renderer);
+	if(frames != NULL) {
+		sem_destroy(&frames->ready);
+		free(frames);
+	}
+	destroy_pacer(pacer);
+	free(pacer);
 	free(interrupts);
 	free(memory);
+	destroyCPU(cpu);
 	free(cpu);
 
 	return status;
 }
 
+/* Copies VRAM into the back frame, and publishes it for the render thread. Nothing here waits on the other threads. */
+void finish_frame(GameState *game_state) {
+	FrameQueue *queue = game_state->frames;
+	CPU *cpu = game_state->cpu;
+	Frame *frame = &queue->frames[queue->buffer.back];
+
+	/* the back frame is two or more frames old, so all of VRAM is copied. which lines changed is passed on for the renderer */
+	memcpy(frame->vram, &game_state->memory[VRAM_START_ADDRESS], FRAME_SIZE);
+	memcpy(frame->dirty, cpu->vram_dirty, NUM_OF_VRAM_LINES);
+	memset(cpu->vram_dirty, 0, NUM_OF_VRAM_LINES);
+	frame->number = ++queue->finished;
+
+	publish_triple_buffer(&queue->buffer);
+	sem_post(&queue->ready);
+}
+
+/* The CPU thread keeps its own time, counted in emulated cycles, and raises the mid-screen (RST 1) and vblank (RST 2) interrupts when the
+ * beam would have reached them. Each batch runs up to the next interrupt, so they land on exactly the same cycle no matter how busy the
+ * host is. */
 void *emulate_cpu(void *state) {
 	GameState *game_state = (GameState *)state;
 	CPU *cpu = game_state->cpu;
 	Interrupt *interrupts = game_state->interrupts;
-	int success;
+
+	unsigned long long total_cycles = 0;
+	unsigned long long next_interrupt = CYCLES_PER_HALF_FRAME;
+	int next_is_vblank = 0;
+	unsigned long frames_finished = 0;
 
 	sem_wait(game_state->thread_sync); /* TODO: check for failure */
 
+	/* Each half frame is run flat out, and then the thread waits until the moment it should have finished in real time. This is the host's
+	 * whole loop: inputs are taken in, a half frame is run, and the frame it finishes is handed on, once per deadline. */
+	start_pacer(game_state->pacer);
+
 	/* main emulation loop */
 	while(1) {
-		struct timespec now;
-		struct timespec after;
-
-		timespec_get(&now, TIME_UTC);
-
 		/* check if emulation has stopped */
 		if(*game_state->thread_exit == 1) {
 			break;
 		}
 
+		/* inputs reach the game between batches, on the cycle it has got to */
+		apply_queued_inputs(game_state->game_control, total_cycles);
+
 		/* handle interrupts */
 		if(interrupt_waiting(interrupts)) {
 			cpu->halted = 0; /* restart the CPU, if it is halted. */
@@ -186,28 +355,50 @@ void *emulate_cpu(void *state) {
 			clear_interrupts(interrupts);
 		}
 
-		/* emulate an instruction, keeping track of time elapsed */
-		uint8_t cycles_elapsed = emulate(cpu, game_state->memory, interrupts);
-
-		timespec_get(&after, TIME_UTC);
-
-		/* calculate total amount of time to sleep before next instruction */
-		long time_elapsed = after.tv_nsec - now.tv_nsec;
-		//fprintf(stdout, "Time elapsed: %ld nanoseconds\n", time_elapsed);
-		struct timespec instruction_time;
-		instruction_time.tv_sec = 0;
-		/* amount of time to wait, measured in nanoseconds */
-		instruction_time.tv_nsec = (cycles_elapsed * CYCLE_LENGTH) - time_elapsed;
-		//fprintf(stdout, "Time to sleep: %ld nanoseconds\n", instruction_time.tv_nsec);
-		if(instruction_time.tv_nsec >= 0) {
-			success = nanosleep(&instruction_time, NULL);
-			if(success == -1) {
-				fprintf(stderr, "WARNING: nanosleep unable to sleep full duration of elapsed cycles.\n%s\n", strerror(errno));
-				if(errno == EINVAL) {
-					fprintf(stderr, "Argument given: %ld seconds %ld nanoseconds\n", instruction_time.tv_sec, instruction_time.tv_nsec);
+		if(cpu->halted && !interrupts_enabled(interrupts)) {
+			/* Only an interrupt can restart a halted CPU, and none will ever be raised with interrupts disabled. Rather than count out empty
+			 * half frames forever, sleep until the emulator exits. With a frame limit, every frame left would be the same as this one, so
+			 * hand it on and stop now instead. */
+			if(game_state->frame_limit != 0) {
+				if(game_state->frames != NULL) {
+					finish_frame(game_state);
+				}
+				quit_display();
+				break;
+			}
+			park_pacer(game_state->pacer);
+			continue;
+		}
+
+		/* emulate up to the next interrupt, or the next replayed input if it comes first, keeping track of time elapsed. a halted CPU skips
+		 * straight to it, and then the thread sleeps through to its deadline in pace(), so halting costs the host nothing until the
+		 * interrupt wakes it */
+		unsigned long long batch_end = next_interrupt;
+		if(next_replayed_input(game_state->game_control) < batch_end) {
+			batch_end = next_replayed_input(game_state->game_control);
+		}
+		unsigned long cycles_elapsed = run_cycles(cpu, game_state->memory, interrupts, batch_end - total_cycles);
+		total_cycles += cycles_elapsed;
+
+		if(total_cycles >= next_interrupt) {
+			if(next_is_vblank) {
+				trigger_vblank(interrupts);
+				if(game_state->frames != NULL) {
+					finish_frame(game_state);
 				}
+				if(++frames_finished == game_state->frame_limit) {
+					quit_display(); /* the main thread then stops this one, as it would if the display had been closed */
+					break;
+				}
+			}
+			else {
+				trigger_hblank(interrupts);
 			}
+			next_is_vblank = !next_is_vblank;
+			next_interrupt += CYCLES_PER_HALF_FRAME;
 		}
+
+		pace(game_state->pacer, (long)cycles_elapsed * CYCLE_LENGTH);
 	}
 
 	pthread_exit(EXIT_SUCCESS);
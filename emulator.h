@@ -4,6 +4,8 @@
 #include "cpu8080.h"
 #include "interrupts.h"
 #include "controls.h"
+#include "pacing.h"
+#include "triplebuffer.h"
 
 #include <stdint.h>
 //#include <threads.h>
@@ -11,12 +13,34 @@
 #include <pthread.h>
 #include <semaphore.h>
 
+#define FRAME_SIZE 0x1c00 /* the size of VRAM, which holds exactly one frame */
+
+/* A finished frame, copied out of VRAM by the CPU thread at vblank. The display only ever draws from these, so what it shows does not depend
+ * on how far through the next frame the CPU happens to be. */
+typedef struct {
+	uint8_t vram[FRAME_SIZE];
+	uint8_t dirty[NUM_OF_VRAM_LINES]; /* 1 for each line of vram written to since the frame before this one */
+	unsigned long number; /* counts up from 1 with each finished frame */
+} Frame;
+
+/* Finished frames on their way from the CPU thread to the render thread. The CPU thread fills frames[buffer.back] and the render thread reads
+ * frames[buffer.front], so neither ever waits for the other, and a frame is never read while it is being written. */
+typedef struct {
+	Frame frames[3];
+	TripleBuffer buffer;
+	sem_t ready; /* posted with each frame published, for the render thread to wait on */
+	unsigned long finished; /* the number of frames finished so far. only to be used by the CPU thread */
+} FrameQueue;
+
 /* Contains all information that other threads need to know about the machines state. Anything that gets included in a GameState should be allocated on the heap */
 typedef struct {
 	CPU *cpu;
 	uint8_t *memory;
 	Interrupt *interrupts;
 	GameControl *game_control;
+	FrameQueue *frames; /* NULL if the frames are not being rendered */
+	unsigned long frame_limit; /* how many frames to run before stopping. 0 to run until the display is closed */
+	Pacer *pacer;
 	sem_t *thread_sync;
 	int *thread_exit;
 } GameState;
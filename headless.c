@@ -0,0 +1,109 @@
+#include "display.h"
+#include "present.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <semaphore.h>
+#include <time.h>
+
+/* A display backend with no display. Each image the renderer finishes is presented into memory, just as the GTK display would put it on
+ * the screen, and nothing ever reads the controls. It runs until the emulator stops itself, or is interrupted. */
+
+#define HEADLESS_REFRESH_INTERVAL (NANOSECONDS_PER_SECOND / 120) /* checks for new images as often as the GTK display does */
+#define HEADLESS_STRIDE (PRESENT_WIDTH * sizeof(uint32_t)) /* rows are packed, so every pixel in the buffer is one of the screen's, and gets drawn */
+
+typedef struct {
+	Renderer *renderer; /* NULL if nothing is being rendered */
+	unsigned long image_shown;
+	Presenter presenter;
+	uint32_t pixels[PRESENT_HEIGHT * PRESENT_WIDTH]; /* the image being shown, as 0x00RRGGBB, at a scale of 1, HEADLESS_STRIDE bytes to a row */
+	sem_t quit; /* posted by quit_display() */
+} Headless;
+
+static Headless headless;
+
+/* SIGINT and SIGTERM stop the emulator as closing the window would. sem_post() is safe in a signal handler */
+static void quit_on_signal(int signal_number) {
+	sem_post(&headless.quit);
+}
+
+/* Presents the newest image the render thread has finished, if there is one that has not been shown yet. */
+static void refresh() {
+	Renderer *renderer = headless.renderer;
+	if(!take_triple_buffer(&renderer->buffer)) {
+		return;
+	}
+
+	Image *image = &renderer->images[renderer->buffer.front];
+	uint32_t blocks = image->number == headless.image_shown + 1 ? image->blocks : ROTATION_ALL_BLOCKS;
+	headless.image_shown = image->number;
+	present_image(&headless.presenter, image->pixels, headless.pixels, HEADLESS_STRIDE, blocks);
+}
+
+int init_display(GameState *game_state, Renderer *renderer) {
+	if(renderer != NULL && initialize_presenter(&headless.presenter, 1) != 0) {
+		return -1;
+	}
+	headless.renderer = renderer;
+	headless.image_shown = 0;
+	memset(headless.pixels, 0, sizeof(headless.pixels));
+	return sem_init(&headless.quit, 0, 0);
+}
+
+int run_display(int argc, char **argv) {
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = quit_on_signal;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	if(headless.renderer == NULL) {
+		while(sem_wait(&headless.quit) == -1 && errno == EINTR) {
+			continue;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline); /* sem_timedwait only goes by the realtime clock */
+	while(1) {
+		add_nanoseconds(&deadline, HEADLESS_REFRESH_INTERVAL);
+		if(sem_timedwait(&headless.quit, &deadline) == 0) {
+			break;
+		}
+		if(errno == ETIMEDOUT) {
+			refresh();
+
+			/* if refreshing has fallen behind, carry on from now rather than rush to catch up */
+			struct timespec now;
+			clock_gettime(CLOCK_REALTIME, &now);
+			if(nanoseconds_between(&deadline, &now) > HEADLESS_REFRESH_INTERVAL) {
+				deadline = now;
+			}
+		}
+		else if(errno != EINTR) {
+			fprintf(stderr, "ERROR: sem_timedwait unable to wait for the next refresh.\n%s\n", strerror(errno));
+			return EXIT_FAILURE;
+		}
+	}
+
+	refresh(); /* so that the last image finished is the one left in memory */
+	return EXIT_SUCCESS;
+}
+
+void quit_display() {
+	sem_post(&headless.quit);
+}
+
+void close_display() {
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	if(headless.renderer != NULL) {
+		destroy_presenter(&headless.presenter);
+	}
+	sem_destroy(&headless.quit);
+}
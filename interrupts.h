@@ -2,20 +2,17 @@
 #define SPINV_INTERRUPTS
 
 #include <stdint.h>
-#include <pthread.h>
+#include <stdatomic.h>
 
-/* interrupt vector: its fields are boolean variables indicating whether there is an interrupt of that type waiting. */
-typedef struct {
-	uint8_t hblank:1;
-	uint8_t vblank:1;
-	uint8_t padding:6;
-} InterruptVector;
+/* bits of the interrupt vector, each set while an interrupt of that type is waiting */
+#define INTERRUPT_HBLANK 0x01
+#define INTERRUPT_VBLANK 0x02
 
+/* Interrupts are set and checked from multiple threads. Both fields are atomic, so no locks are needed: raising an interrupt publishes it
+ * with release ordering, and the CPU side acquires it before acting on it. */
 typedef struct {
-	InterruptVector vector;
-	pthread_mutex_t vector_mutex; /* interrupts are set and checked from multiple threads. Acquire the mutex before modifying the interrupt_vector's fields. */
-	uint8_t inte; /* a special bit in the CPU which determines if interrupts are enabled or disabled */
-	pthread_mutex_t inte_mutex;
+	atomic_uint_fast8_t vector; /* INTERRUPT_ bits for every interrupt waiting */
+	atomic_uint_fast8_t inte; /* a special bit in the CPU which determines if interrupts are enabled or disabled */
 } Interrupt;
 
 void initialize_interrupts(Interrupt *interrupts);
@@ -24,7 +21,13 @@ void destroy_interrupts(Interrupt *interrupts);
 void enable_interrupts(Interrupt *interrupts);
 void disable_interrupts(Interrupt *interrupts);
 
-int interrupt_waiting(Interrupt *interrupts);
+/* polled between every batch of instructions, so kept to a single relaxed load. load_interrupt_instruction() synchronizes properly */
+static inline int interrupt_waiting(Interrupt *interrupts) {
+	return atomic_load_explicit(&interrupts->vector, memory_order_relaxed) != 0;
+}
+static inline int interrupts_enabled(Interrupt *interrupts) {
+	return atomic_load_explicit(&interrupts->inte, memory_order_acquire) != 0;
+}
 void load_interrupt_instruction(Interrupt *interrupts, uint8_t *dest);
 
 void trigger_hblank(Interrupt *interrupts);
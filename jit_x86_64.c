@@ -0,0 +1,674 @@
+#include "jit_x86_64.h"
+#include "cpu8080.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __x86_64__
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* Host registers, numbered the way x86-64 encodes them. */
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RBX 3
+#define RBP 5
+#define RSI 6
+#define RDI 7
+#define R8  8
+#define R9  9
+#define R10 10
+#define R11 11
+#define R12 12
+
+/* Translated code is called as native(cpu, mem), so the System V calling convention hands it the CPU in RDI and memory in RSI. While it runs,
+ * each 8080 register lives in a host register of its own, zero-extended to 32 bits. RAX, RCX and RDX are scratch. */
+#define HOST_CPU RDI
+#define HOST_MEM RSI
+#define HOST_H RBX
+#define HOST_L RBP
+#define HOST_A R12
+
+#define OPERAND_M 6 /* 8080 instructions number their register operands B, C, D, E, H, L, M, A */
+static const int host_register[8] = { R8, R9, R10, R11, HOST_H, HOST_L, -1, HOST_A };
+static const int register_offset[8] = { offsetof(CPU, b), offsetof(CPU, c), offsetof(CPU, d), offsetof(CPU, e), offsetof(CPU, h), offsetof(CPU, l), -1, offsetof(CPU, a) };
+
+#define FLAGS_OFFSET offsetof(CPU, flags)
+#define LAZY_OFFSET(field) (offsetof(CPU, lazy_flags) + offsetof(LazyFlags, field))
+
+/* Prefix flags for the encoders below. */
+#define WIDE 0x08      /* REX.W - 64-bit operands */
+#define BYTE_REGS 0x40 /* always emit a REX prefix, so that registers 4-7 are SPL-DIL in byte operations rather than AH-BH */
+#define WORD 0x100     /* operand size prefix - 16-bit operands */
+
+/* the /digit opcode extensions of the immediate ALU (0x80, 0x81) and shift (0xc1) groups */
+#define EXT_ADD 0
+#define EXT_OR  1
+#define EXT_AND 4
+#define EXT_SUB 5
+#define EXT_XOR 6
+#define EXT_CMP 7
+#define EXT_SHL 4
+#define EXT_SHR 5
+
+/* condition codes for emit_jump */
+#define CC_B 0x2
+#define CC_AE 0x3
+#define CC_E 0x4
+
+#define IMMEDIATE(value) (0x100 | (value)) /* marks an operand of emit_store_operand as a constant rather than a register */
+
+#define MAX_BYTES_PER_INSTRUCTION 256 /* generous - the longest translation (SHLD) comes to well under half that */
+
+static _Thread_local uint8_t *out; /* where the next byte of code goes. per thread, so that CPUs on different threads can translate at once */
+
+/* The buffer is never writable and executable at once. It is mapped read-write, and the pages a block is translated into are only made
+ * writable for as long as it takes to write it, then read-only and executable again. */
+void initialize_jit(BlockCache *cache) {
+	cache->native_code = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(cache->native_code == MAP_FAILED) {
+		fprintf(stderr, "WARNING: Unable to map memory for the JIT. Falling back to the interpreter.\n");
+		cache->native_code = NULL;
+	}
+	cache->native_used = 0;
+}
+
+void destroy_jit(BlockCache *cache) {
+	if(cache->native_code != NULL) {
+		munmap(cache->native_code, JIT_BUFFER_SIZE);
+		cache->native_code = NULL;
+	}
+}
+
+/* changes the protection of every page from start up to end */
+static int protect(uint8_t *start, uint8_t *end, int protection) {
+	uintptr_t page_size = sysconf(_SC_PAGESIZE);
+	uintptr_t first = (uintptr_t)start & ~(page_size - 1);
+	return mprotect((void *)first, (uintptr_t)end - first, protection);
+}
+
+/* For when the buffer's protection cannot be changed. No block can be trusted to run from it any more, so every one goes back to the
+ * interpreter, and the buffer is unmapped so that nothing more gets translated. */
+static void abandon_jit(BlockCache *cache) {
+	int i;
+	fprintf(stderr, "WARNING: Unable to change the protection of the JIT's memory. Falling back to the interpreter.\n");
+	for(i = 0; i < cache->blocks_used; ++i) {
+		cache->blocks[i].native = NULL;
+		cache->blocks[i].native_length = 0;
+	}
+	destroy_jit(cache);
+}
+
+/* ----- encoding ----- */
+
+static void emit8(uint8_t byte) {
+	*out++ = byte;
+}
+
+static void emit16(uint16_t word) {
+	memcpy(out, &word, 2);
+	out += 2;
+}
+
+static void emit32(uint32_t dword) {
+	memcpy(out, &dword, 4);
+	out += 4;
+}
+
+static void emit64(uint64_t qword) {
+	memcpy(out, &qword, 8);
+	out += 8;
+}
+
+static void emit_prefixes(int flags, int reg, int index, int base) {
+	uint8_t rex = 0x40 | (flags & WIDE) | ((reg >> 3) & 1) << 2 | ((index >> 3) & 1) << 1 | ((base >> 3) & 1);
+	if(flags & WORD) {
+		emit8(0x66);
+	}
+	if(rex != 0x40 || (flags & BYTE_REGS)) {
+		emit8(rex);
+	}
+}
+
+static void emit_opcode(int opcode) {
+	if(opcode > 0xff) {
+		emit8(opcode >> 8); /* two-byte opcodes (0x0f xx) */
+	}
+	emit8(opcode & 0xff);
+}
+
+/* an instruction with two register operands: reg goes in ModRM.reg, rm in ModRM.rm */
+static void emit_rr(int flags, int opcode, int reg, int rm) {
+	emit_prefixes(flags, reg, 0, rm);
+	emit_opcode(opcode);
+	emit8(0xc0 | (reg & 7) << 3 | (rm & 7));
+}
+
+/* an instruction with a memory operand, [base + index + disp] (index is -1 for none). base is never RSP or R12, which would need a SIB byte */
+static void emit_rm(int flags, int opcode, int reg, int base, int index, int32_t disp) {
+	emit_prefixes(flags, reg, index < 0 ? 0 : index, base);
+	emit_opcode(opcode);
+	if(index < 0) {
+		emit8(0x80 | (reg & 7) << 3 | (base & 7));
+	}
+	else {
+		emit8(0x84 | (reg & 7) << 3);
+		emit8((index & 7) << 3 | (base & 7));
+	}
+	emit32(disp);
+}
+
+static void mov_rr(int dst, int src) { emit_rr(0, 0x89, src, dst); }
+static void add_rr(int dst, int src) { emit_rr(0, 0x01, src, dst); }
+static void or_rr(int dst, int src)  { emit_rr(0, 0x09, src, dst); }
+static void and_rr(int dst, int src) { emit_rr(0, 0x21, src, dst); }
+static void sub_rr(int dst, int src) { emit_rr(0, 0x29, src, dst); }
+static void xor_rr(int dst, int src) { emit_rr(0, 0x31, src, dst); }
+static void xchg_rr(int dst, int src) { emit_rr(0, 0x87, src, dst); }
+static void neg_r(int dst) { emit_rr(0, 0xf7, 3, dst); }
+
+static void mov_ri(int dst, uint32_t imm) {
+	emit_prefixes(0, 0, 0, dst);
+	emit8(0xb8 | (dst & 7));
+	emit32(imm);
+}
+
+static void alu_ri(int ext, int dst, uint32_t imm) {
+	emit_rr(0, 0x81, ext, dst);
+	emit32(imm);
+}
+
+static void shift_ri(int ext, int dst, uint8_t count) {
+	emit_rr(0, 0xc1, ext, dst);
+	emit8(count);
+}
+
+static void push_r(int reg) {
+	emit_prefixes(0, 0, 0, reg);
+	emit8(0x50 | (reg & 7));
+}
+
+static void pop_r(int reg) {
+	emit_prefixes(0, 0, 0, reg);
+	emit8(0x58 | (reg & 7));
+}
+
+/* movzx dst, byte [base + index + disp] */
+static void load_byte(int dst, int base, int index, int32_t disp) {
+	emit_rm(0, 0x0fb6, dst, base, index, disp);
+}
+
+/* mov byte [base + index + disp], src */
+static void store_byte(int base, int index, int32_t disp, int src) {
+	emit_rm(BYTE_REGS, 0x88, src, base, index, disp);
+}
+
+/* mov byte [base + index + disp], imm */
+static void store_byte_imm(int base, int index, int32_t disp, uint8_t imm) {
+	emit_rm(0, 0xc6, 0, base, index, disp);
+	emit8(imm);
+}
+
+/* 0x80 group: op byte [base + disp], imm */
+static void alu_mem8_imm(int ext, int base, int32_t disp, uint8_t imm) {
+	emit_rm(0, 0x80, ext, base, -1, disp);
+	emit8(imm);
+}
+
+/* jcc rel32, to be pointed somewhere with patch_jump once that is known */
+static uint8_t *emit_jump(uint8_t condition) {
+	emit8(0x0f);
+	emit8(0x80 | condition);
+	emit32(0);
+	return out;
+}
+
+/* points the jump that ended at 'from' at the next byte of code */
+static void patch_jump(uint8_t *from) {
+	int32_t displacement = out - from;
+	memcpy(from - 4, &displacement, 4);
+}
+
+/* ----- 8080 building blocks ----- */
+
+/* dst = (high << 8) | low */
+static void emit_pair(int dst, int high, int low) {
+	mov_rr(dst, high);
+	shift_ri(EXT_SHL, dst, 8);
+	or_rr(dst, low);
+}
+
+/* high = (src >> 8) & 0xff, low = src & 0xff. src is clobbered */
+static void emit_split(int src, int high, int low) {
+	mov_rr(low, src);
+	alu_ri(EXT_AND, low, 0xff);
+	shift_ri(EXT_SHR, src, 8);
+	alu_ri(EXT_AND, src, 0xff);
+	mov_rr(high, src);
+}
+
+/* stores a register, or an IMMEDIATE(), to a byte of the CPU */
+static void emit_store_operand(int32_t offset, int operand) {
+	if(operand & 0x100) {
+		store_byte_imm(HOST_CPU, -1, offset, operand & 0xff);
+	}
+	else {
+		store_byte(HOST_CPU, -1, offset, operand);
+	}
+}
+
+/* the record set_zspac() makes, for the flags to be worked out later. It is made in two halves, as ac_lhs is usually what the register held
+ * before the operation, and result what it holds after */
+static void emit_set_ac(int ac_lhs, int ac_rhs) {
+	emit_store_operand(LAZY_OFFSET(ac_lhs), ac_lhs);
+	emit_store_operand(LAZY_OFFSET(ac_rhs), ac_rhs);
+}
+
+static void emit_set_zsp(int result) {
+	emit_store_operand(LAZY_OFFSET(result), result);
+	store_byte_imm(HOST_CPU, -1, LAZY_OFFSET(pending), 1);
+}
+
+/* cy = bit 'bit' of result. Clobbers RDX, so result must not be RDX */
+static void emit_set_cy(int result, int bit) {
+	mov_rr(RDX, result);
+	if(bit > 0) {
+		shift_ri(EXT_SHR, RDX, bit);
+	}
+	alu_ri(EXT_AND, RDX, FLAG_CY);
+	alu_mem8_imm(EXT_AND, HOST_CPU, FLAGS_OFFSET, (uint8_t)~FLAG_CY);
+	emit_rm(BYTE_REGS, 0x08, RDX, HOST_CPU, -1, FLAGS_OFFSET); /* or byte [flags], dl */
+}
+
+/* Writes a register, or an IMMEDIATE(), to the 8080 address in EAX, exactly as write_byte() does: writes to ROM or past RAM are dropped, writes to VRAM
+ * mark their line dirty, and writes to RAM that cached code was decoded from call invalidate_code(). Clobbers RDX. */
+static void emit_write(int value) {
+	alu_ri(EXT_CMP, RAX, ROM_SIZE);
+	uint8_t *skip_rom = emit_jump(CC_B);
+	alu_ri(EXT_CMP, RAX, MEMORY_SIZE);
+	uint8_t *skip_unmapped = emit_jump(CC_AE);
+
+	if(value & 0x100) {
+		store_byte_imm(HOST_MEM, RAX, 0, value & 0xff);
+	}
+	else {
+		store_byte(HOST_MEM, RAX, 0, value);
+	}
+
+	alu_ri(EXT_CMP, RAX, VRAM_START_ADDRESS);
+	uint8_t *skip_vram = emit_jump(CC_B);
+	mov_rr(RDX, RAX);
+	shift_ri(EXT_SHR, RDX, VRAM_LINE_SHIFT);
+	store_byte_imm(HOST_CPU, RDX, (int32_t)offsetof(CPU, vram_dirty) - (VRAM_START_ADDRESS >> VRAM_LINE_SHIFT), 1); /* cpu->vram_dirty[line] = 1 */
+	patch_jump(skip_vram);
+
+	mov_rr(RDX, RAX);
+	shift_ri(EXT_SHR, RDX, CODE_PAGE_SHIFT);
+	emit_rm(WIDE, 0x03, RDX, HOST_CPU, -1, offsetof(CPU, block_cache)); /* add rdx, [cpu->block_cache] */
+	alu_mem8_imm(EXT_CMP, RDX, offsetof(BlockCache, code_pages), 0);
+	uint8_t *skip_clean = emit_jump(CC_E);
+
+	/* rare: the page holds cached code. Six pushes keep the stack 16-byte aligned for the call, as the prologue left it */
+	push_r(RDI); push_r(RSI); push_r(R8); push_r(R9); push_r(R10); push_r(R11);
+	emit_rm(WIDE, 0x8b, RDI, HOST_CPU, -1, offsetof(CPU, block_cache)); /* mov rdi, [cpu->block_cache] */
+	mov_rr(RSI, RAX);
+	emit8(0x48); emit8(0xb8); emit64((uint64_t)(uintptr_t)&invalidate_code); /* mov rax, invalidate_code */
+	emit8(0xff); emit8(0xd0); /* call rax */
+	pop_r(R11); pop_r(R10); pop_r(R9); pop_r(R8); pop_r(RSI); pop_r(RDI);
+
+	patch_jump(skip_rom);
+	patch_jump(skip_unmapped);
+	patch_jump(skip_clean);
+}
+
+/* EAX = HL */
+static void emit_address_m(void) {
+	emit_pair(RAX, HOST_H, HOST_L);
+}
+
+/* ECX = the source operand of a MOV or an ALU operation */
+static void emit_load_operand(int operand) {
+	if(operand == OPERAND_M) {
+		emit_address_m();
+		load_byte(RCX, HOST_MEM, RAX, 0);
+	}
+	else {
+		mov_rr(RCX, host_register[operand]);
+	}
+}
+
+/* One of ADD, ADC, SUB, SBB, ANA, XRA, ORA, CMP (numbered as the opcodes number them) on A and ECX, setting the flags exactly as ADI...CPI do. */
+static void emit_alu(int operation) {
+	if(operation >= 4 && operation <= 6) {
+		if(operation == 4) {
+			and_rr(HOST_A, RCX);
+		}
+		else if(operation == 5) {
+			xor_rr(HOST_A, RCX);
+		}
+		else {
+			or_rr(HOST_A, RCX);
+		}
+		emit_set_ac(IMMEDIATE(0), IMMEDIATE(0));
+		emit_set_zsp(HOST_A);
+		alu_mem8_imm(EXT_AND, HOST_CPU, FLAGS_OFFSET, (uint8_t)~FLAG_CY);
+		return;
+	}
+
+	if(operation == 1 || operation == 3) { /* ADC, SBB - EDX = the carry in */
+		load_byte(RDX, HOST_CPU, -1, FLAGS_OFFSET);
+		alu_ri(EXT_AND, RDX, FLAG_CY);
+	}
+	if(operation == 3) {
+		add_rr(RCX, RDX); /* a - imm - cy is a - (imm + cy) */
+	}
+
+	/* EAX = what gets added to the low half of A */
+	mov_rr(RAX, RCX);
+	if(operation >= 2) {
+		neg_r(RAX);
+	}
+	alu_ri(EXT_AND, RAX, 0x0f);
+	if(operation == 1) {
+		add_rr(RAX, RDX);
+	}
+	emit_set_ac(HOST_A, RAX);
+
+	mov_rr(RAX, HOST_A);
+	if(operation <= 1) {
+		add_rr(RAX, RCX);
+		if(operation == 1) {
+			add_rr(RAX, RDX);
+		}
+	}
+	else {
+		sub_rr(RAX, RCX);
+	}
+	emit_set_zsp(RAX);
+	emit_set_cy(RAX, 8);
+
+	if(operation != 7) {
+		mov_rr(HOST_A, RAX);
+		alu_ri(EXT_AND, HOST_A, 0xff);
+	}
+}
+
+/* INR (delta 1) or DCR (delta -1) on a host register */
+static void emit_inr_dcr(int reg, int delta) {
+	emit_set_ac(reg, IMMEDIATE(delta > 0 ? 0x01 : 0x0f));
+	alu_ri(delta > 0 ? EXT_ADD : EXT_SUB, reg, 1);
+	alu_ri(EXT_AND, reg, 0xff);
+	emit_set_zsp(reg);
+}
+
+/* Whether emit_instruction() can translate an instruction. Anything that branches, touches the stack or I/O, or changes interrupt state is
+ * left to the interpreter, and ends the translated part of its block. */
+static int translatable(uint8_t op) {
+	if(op >= 0x40 && op <= 0xbf) {
+		return op != 0x76; /* MOV and the register ALU operations. 0x76 is HLT */
+	}
+
+	switch(op) {
+		case 0x00: /* NOP */
+		case 0x06: case 0x0e: case 0x16: case 0x1e: case 0x26: case 0x2e: case 0x36: case 0x3e: /* MVI */
+		case 0x01: case 0x11: case 0x21: case 0x31: /* LXI */
+		case 0x03: case 0x13: case 0x23: case 0x33: /* INX */
+		case 0x0b: case 0x1b: case 0x2b: case 0x3b: /* DCX */
+		case 0x04: case 0x0c: case 0x14: case 0x1c: case 0x24: case 0x2c: case 0x34: case 0x3c: /* INR */
+		case 0x05: case 0x0d: case 0x15: case 0x1d: case 0x25: case 0x2d: case 0x35: case 0x3d: /* DCR */
+		case 0x09: case 0x19: case 0x29: case 0x39: /* DAD */
+		case 0xc6: case 0xce: case 0xd6: case 0xde: case 0xe6: case 0xee: case 0xf6: case 0xfe: /* ADI...CPI */
+		case 0x07: case 0x0f: case 0x17: case 0x1f: /* RLC, RRC, RAL, RAR */
+		case 0x2f: case 0x37: case 0x3f: case 0xeb: /* CMA, STC, CMC, XCHG */
+		case 0x3a: case 0x32: case 0x2a: case 0x22: /* LDA, STA, LHLD, SHLD */
+		case 0x0a: case 0x1a: case 0x02: case 0x12: /* LDAX, STAX */
+			return 1;
+	}
+	return 0;
+}
+
+static void emit_instruction(const DecodedInstruction *ins) {
+	uint8_t op = ins->op;
+	int dst = (op >> 3) & 7; /* the register operand encoded in bits 3-5 */
+	int src = op & 7;        /* the register operand encoded in bits 0-2 */
+	int high = host_register[((op >> 4) & 3) * 2]; /* the register pair encoded in bits 4-5 */
+	int low = host_register[((op >> 4) & 3) * 2 + 1];
+
+	if(op >= 0x40 && op <= 0x7f) { /* MOV */
+		if(dst == OPERAND_M) {
+			emit_address_m();
+			emit_write(host_register[src]);
+		}
+		else if(src == OPERAND_M) {
+			emit_address_m();
+			load_byte(host_register[dst], HOST_MEM, RAX, 0);
+		}
+		else {
+			mov_rr(host_register[dst], host_register[src]);
+		}
+		return;
+	}
+
+	if(op >= 0x80 && op <= 0xbf) { /* ADD...CMP */
+		emit_load_operand(src);
+		emit_alu(dst);
+		return;
+	}
+
+	switch(op) {
+		case 0x00: /* NOP */
+			break;
+
+		case 0x06: case 0x0e: case 0x16: case 0x1e: case 0x26: case 0x2e: case 0x3e: /* MVI */
+			mov_ri(host_register[dst], ins->operand);
+			break;
+		case 0x36: /* MVI M */
+			emit_address_m();
+			emit_write(IMMEDIATE(ins->operand));
+			break;
+
+		case 0x01: case 0x11: case 0x21: /* LXI */
+			mov_ri(high, ins->operand >> 8);
+			mov_ri(low, ins->operand & 0xff);
+			break;
+		case 0x31: /* LXI SP */
+			emit_rm(WORD, 0xc7, 0, HOST_CPU, -1, offsetof(CPU, sp));
+			emit16(ins->operand);
+			break;
+
+		case 0x03: case 0x13: case 0x23: /* INX */
+		case 0x0b: case 0x1b: case 0x2b: /* DCX */
+			emit_pair(RAX, high, low);
+			alu_ri(op & 0x08 ? EXT_SUB : EXT_ADD, RAX, 1);
+			emit_split(RAX, high, low);
+			break;
+		case 0x33: case 0x3b: /* INX SP, DCX SP - inc/dec word [cpu->sp] */
+			emit_rm(WORD, 0xff, op & 0x08 ? 1 : 0, HOST_CPU, -1, offsetof(CPU, sp));
+			break;
+
+		case 0x04: case 0x0c: case 0x14: case 0x1c: case 0x24: case 0x2c: case 0x3c: /* INR */
+		case 0x05: case 0x0d: case 0x15: case 0x1d: case 0x25: case 0x2d: case 0x3d: /* DCR */
+			emit_inr_dcr(host_register[dst], op & 0x01 ? -1 : 1);
+			break;
+		case 0x34: case 0x35: /* INR M, DCR M */
+			emit_address_m();
+			load_byte(RCX, HOST_MEM, RAX, 0);
+			emit_inr_dcr(RCX, op & 0x01 ? -1 : 1);
+			emit_write(RCX);
+			break;
+
+		case 0x09: case 0x19: case 0x29: case 0x39: /* DAD */
+			if(op == 0x39) {
+				emit_rm(0, 0x0fb7, RCX, HOST_CPU, -1, offsetof(CPU, sp)); /* movzx ecx, word [cpu->sp] */
+			}
+			else {
+				emit_pair(RCX, high, low);
+			}
+			emit_address_m();
+			add_rr(RAX, RCX);
+			emit_set_cy(RAX, 16);
+			emit_split(RAX, HOST_H, HOST_L);
+			break;
+
+		case 0xc6: case 0xce: case 0xd6: case 0xde: case 0xe6: case 0xee: case 0xf6: case 0xfe: /* ADI...CPI */
+			mov_ri(RCX, ins->operand);
+			emit_alu(dst);
+			break;
+
+		case 0x07: /* RLC */
+			mov_rr(RAX, HOST_A);
+			shift_ri(EXT_SHR, RAX, 7);
+			emit_set_cy(RAX, 0);
+			shift_ri(EXT_SHL, HOST_A, 1);
+			or_rr(HOST_A, RAX);
+			alu_ri(EXT_AND, HOST_A, 0xff);
+			break;
+		case 0x0f: /* RRC */
+			mov_rr(RAX, HOST_A);
+			alu_ri(EXT_AND, RAX, 0x01);
+			emit_set_cy(RAX, 0);
+			shift_ri(EXT_SHR, HOST_A, 1);
+			shift_ri(EXT_SHL, RAX, 7);
+			or_rr(HOST_A, RAX);
+			break;
+		case 0x17: /* RAL */
+			mov_rr(RAX, HOST_A);
+			shift_ri(EXT_SHR, RAX, 7);
+			load_byte(RCX, HOST_CPU, -1, FLAGS_OFFSET);
+			alu_ri(EXT_AND, RCX, FLAG_CY);
+			shift_ri(EXT_SHL, HOST_A, 1);
+			or_rr(HOST_A, RCX);
+			alu_ri(EXT_AND, HOST_A, 0xff);
+			emit_set_cy(RAX, 0);
+			break;
+		case 0x1f: /* RAR */
+			mov_rr(RAX, HOST_A);
+			alu_ri(EXT_AND, RAX, 0x01);
+			load_byte(RCX, HOST_CPU, -1, FLAGS_OFFSET);
+			alu_ri(EXT_AND, RCX, FLAG_CY);
+			shift_ri(EXT_SHL, RCX, 7);
+			shift_ri(EXT_SHR, HOST_A, 1);
+			or_rr(HOST_A, RCX);
+			emit_set_cy(RAX, 0);
+			break;
+
+		case 0x2f: /* CMA */
+			alu_ri(EXT_XOR, HOST_A, 0xff);
+			break;
+		case 0x37: /* STC */
+			alu_mem8_imm(EXT_OR, HOST_CPU, FLAGS_OFFSET, FLAG_CY);
+			break;
+		case 0x3f: /* CMC */
+			alu_mem8_imm(EXT_XOR, HOST_CPU, FLAGS_OFFSET, FLAG_CY);
+			break;
+		case 0xeb: /* XCHG */
+			xchg_rr(HOST_H, host_register[2]);
+			xchg_rr(HOST_L, host_register[3]);
+			break;
+
+		case 0x3a: /* LDA */
+			load_byte(HOST_A, HOST_MEM, -1, ins->operand);
+			break;
+		case 0x32: /* STA */
+			mov_ri(RAX, ins->operand);
+			emit_write(HOST_A);
+			break;
+		case 0x2a: /* LHLD */
+			load_byte(HOST_L, HOST_MEM, -1, ins->operand);
+			load_byte(HOST_H, HOST_MEM, -1, ins->operand + 1);
+			break;
+		case 0x22: /* SHLD */
+			mov_ri(RAX, ins->operand);
+			emit_write(HOST_L);
+			mov_ri(RAX, (uint16_t)(ins->operand + 1));
+			emit_write(HOST_H);
+			break;
+		case 0x0a: case 0x1a: /* LDAX */
+			emit_pair(RAX, high, low);
+			load_byte(HOST_A, HOST_MEM, RAX, 0);
+			break;
+		case 0x02: case 0x12: /* STAX */
+			emit_pair(RAX, high, low);
+			emit_write(HOST_A);
+			break;
+	}
+}
+
+int jit_compile(BlockCache *cache, Block *block) {
+	int length = 0;
+	int i;
+
+	cache->native_used = (cache->native_used + 15) & ~(size_t)15;
+	if(cache->native_code == NULL || cache->native_used + (block->length + 1) * MAX_BYTES_PER_INSTRUCTION > JIT_BUFFER_SIZE) {
+		return 0; /* once the buffer is full, whatever has not been translated yet stays interpreted */
+	}
+
+	while(length < block->length && translatable(block->instructions[length].op)) {
+		++length;
+	}
+	if(length < 2) {
+		return 0; /* not worth the trip in and out of native code */
+	}
+
+	uint8_t *start = cache->native_code + cache->native_used;
+	uint8_t *end = start + (block->length + 1) * MAX_BYTES_PER_INSTRUCTION; /* as far as the block could possibly reach */
+	if(protect(start, end, PROT_READ | PROT_WRITE) != 0) {
+		abandon_jit(cache);
+		return 0;
+	}
+	out = start;
+
+	/* prologue: save the callee-saved registers the 8080 registers are kept in, then load them */
+	push_r(RBX);
+	push_r(RBP);
+	push_r(R12);
+	for(i = 0; i < 8; ++i) {
+		if(i != OPERAND_M) {
+			load_byte(host_register[i], HOST_CPU, -1, register_offset[i]);
+		}
+	}
+
+	for(i = 0; i < length; ++i) {
+		emit_instruction(&block->instructions[i]);
+	}
+
+	/* epilogue: write the registers back, and leave PC after the last translated instruction */
+	for(i = 0; i < 8; ++i) {
+		if(i != OPERAND_M) {
+			store_byte(HOST_CPU, -1, register_offset[i], host_register[i]);
+		}
+	}
+	emit_rm(WORD, 0xc7, 0, HOST_CPU, -1, offsetof(CPU, pc));
+	emit16(block->instructions[length - 1].next_pc);
+	pop_r(R12);
+	pop_r(RBP);
+	pop_r(RBX);
+	emit8(0xc3); /* ret */
+
+	if(protect(start, end, PROT_READ | PROT_EXEC) != 0) {
+		abandon_jit(cache);
+		return 0;
+	}
+
+	cache->native_used = out - cache->native_code;
+	block->native = (void (*)(void *, uint8_t *))start;
+	block->native_length = length;
+	return length;
+}
+
+#else
+
+/* Translation is only implemented for x86-64 hosts. Everywhere else, every block is left to the interpreter. */
+void initialize_jit(BlockCache *cache) {
+	cache->native_code = NULL;
+}
+void destroy_jit(BlockCache *cache) {}
+
+int jit_compile(BlockCache *cache, Block *block) {
+	return 0;
+}
+
+#endif
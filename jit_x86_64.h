@@ -0,0 +1,17 @@
+#ifndef SPINV_JIT_X86_64
+#define SPINV_JIT_X86_64
+
+#include "blockcache.h"
+
+#define JIT_THRESHOLD 16 /* a block is translated the time it runs for this many times */
+#define JIT_BUFFER_SIZE (1 << 20)
+
+/* sets up the buffer that cache's translated code is written to. If that fails, a warning is printed and every block is left to the interpreter */
+void initialize_jit(BlockCache *cache);
+void destroy_jit(BlockCache *cache);
+
+/* translates as many instructions from the start of block, one of cache's, as the JIT supports into native x86-64 code, which block->native
+ * is set to. Returns the number of instructions translated, or 0 if there was nothing worth translating (or no room left to put it). */
+int jit_compile(BlockCache *cache, Block *block);
+
+#endif
@@ -0,0 +1,43 @@
+#include "keyboard.h"
+
+/* the input bits each key controls, or 0 */
+static uint32_t key_inputs(guint keyval) {
+	switch(keyval) {
+		case CREDIT:   return INPUT_CREDIT;
+		case P1_START: return INPUT_P1_START;
+		case P1_FIRE:  return INPUT_P1_FIRE;
+		case P1_LEFT:  return INPUT_P1_LEFT;
+		case P1_RIGHT: return INPUT_P1_RIGHT;
+		case P2_START: return INPUT_P2_START;
+		case P2_FIRE:  return INPUT_P2_FIRE;
+		case P2_LEFT:  return INPUT_P2_LEFT;
+		case P2_RIGHT: return INPUT_P2_RIGHT;
+		default: return 0;
+	}
+}
+
+static void key_press_event(GtkWidget *widget, GdkEventKey *event, gpointer data) {
+	GameControl *game_control = (GameControl *)data;
+	uint32_t inputs = key_inputs(event->keyval);
+	if(inputs != 0) {
+		queue_input(game_control, inputs, 1);
+	}
+	else if(event->keyval == DUMP_VRAM) {
+		dump_vram();
+	}
+}
+
+static void key_release_event(GtkWidget *widget, GdkEventKey *event, gpointer data) {
+	GameControl *game_control = (GameControl *)data;
+	uint32_t inputs = key_inputs(event->keyval);
+	if(inputs != 0) {
+		queue_input(game_control, inputs, 0);
+	}
+}
+
+void set_control_events(GtkWidget *widget, GameControl *game_control) {
+	g_signal_connect(widget, "key-press-event", G_CALLBACK(key_press_event), game_control);
+	g_signal_connect(widget, "key-release-event", G_CALLBACK(key_release_event), game_control);
+
+	gtk_widget_set_events(widget, gtk_widget_get_events(widget) | GDK_KEY_PRESS_MASK | GDK_KEY_RELEASE_MASK);
+}
@@ -0,0 +1,28 @@
+#ifndef SPINV_KEYBOARD
+#define SPINV_KEYBOARD
+
+#include "controls.h"
+
+#include <gtk/gtk.h>
+
+/* Key codes obtained from gdk/gdkkeysyms.h */
+
+#define CREDIT GDK_KEY_c
+
+#define P1_START GDK_KEY_Return
+#define P1_FIRE GDK_KEY_space
+#define P1_LEFT GDK_KEY_Left
+#define P1_RIGHT GDK_KEY_Right
+
+#define P2_START GDK_KEY_KP_Enter
+#define P2_FIRE GDK_KEY_KP_0
+#define P2_LEFT GDK_KEY_KP_4
+#define P2_RIGHT GDK_KEY_KP_6
+
+/* Debug controls */
+#define DUMP_VRAM GDK_KEY_v
+
+/* queues an input for each of the keys above that goes up or down while widget has focus */
+void set_control_events(GtkWidget *widget, GameControl *game_control);
+
+#endif
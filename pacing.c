@@ -0,0 +1,274 @@
+#include "pacing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+/* the upper end of each jitter bucket in nanoseconds. the last bucket takes everything later */
+static const long jitter_limits[JITTER_BUCKETS - 1] = { 10000, 25000, 50000, 100000, 250000, 500000, 1000000 };
+
+void initialize_pacer(Pacer *pacer, PacingMode mode, double speed, int print_stats) {
+	pacer->mode = mode;
+	pacer->speed = speed;
+	pacer->print_stats = print_stats;
+	clock_gettime(CLOCK_MONOTONIC, &pacer->deadline);
+	pacer->second_start = pacer->deadline;
+	memset(&pacer->current, 0, sizeof(PacingStats));
+	memset(&pacer->last, 0, sizeof(PacingStats));
+	pacer->timer_fd = -1;
+	pacer->wake_fd = -1;
+	pacer->epoll_fd = -1;
+	pacer->spin_margin = INITIAL_SPIN_MARGIN;
+	sem_init(&pacer->parked, 0, 0);
+
+	if(mode == PACING_TIMERFD) {
+		pacer->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+		pacer->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		pacer->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if(pacer->timer_fd == -1 || pacer->wake_fd == -1 || pacer->epoll_fd == -1) {
+			fprintf(stderr, "ERROR: Unable to set up the pacing timer.\n%s\n", strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+
+		struct epoll_event event;
+		event.events = EPOLLIN;
+		event.data.fd = pacer->timer_fd;
+		epoll_ctl(pacer->epoll_fd, EPOLL_CTL_ADD, pacer->timer_fd, &event);
+		event.data.fd = pacer->wake_fd;
+		epoll_ctl(pacer->epoll_fd, EPOLL_CTL_ADD, pacer->wake_fd, &event);
+	}
+}
+
+void destroy_pacer(Pacer *pacer) {
+	if(pacer->mode == PACING_TIMERFD) {
+		close(pacer->epoll_fd);
+		close(pacer->wake_fd);
+		close(pacer->timer_fd);
+	}
+	sem_destroy(&pacer->parked);
+}
+
+void start_pacer(Pacer *pacer) {
+	clock_gettime(CLOCK_MONOTONIC, &pacer->deadline);
+	pacer->second_start = pacer->deadline;
+}
+
+void park_pacer(Pacer *pacer) {
+	while(sem_wait(&pacer->parked) == -1 && errno == EINTR) {
+		continue;
+	}
+}
+
+void wake_pacer(Pacer *pacer) {
+	sem_post(&pacer->parked);
+	if(pacer->mode == PACING_TIMERFD) {
+		uint64_t one = 1;
+		if(write(pacer->wake_fd, &one, sizeof(one)) == -1) {
+			fprintf(stderr, "WARNING: Unable to wake the pacing loop.\n%s\n", strerror(errno));
+		}
+	}
+}
+
+static void sleep_until_deadline(Pacer *pacer) {
+	int success;
+	do {
+		success = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &pacer->deadline, NULL);
+	} while(success == EINTR);
+	if(success != 0) {
+		fprintf(stderr, "WARNING: clock_nanosleep unable to sleep until the deadline.\n%s\n", strerror(success));
+	}
+}
+
+/* Sleeps until spin_margin before the deadline, then spins for the rest, so that waking up late from the sleep costs nothing as long as it
+ * is by less than the margin. The margin follows how late the sleeps actually run: it jumps up straight away when a sleep runs past it, and
+ * creeps back down while they keep coming in under it, so that as little time as possible is spent spinning. It never goes past
+ * MAX_SPIN_MARGIN, nor an eighth of interval, the time paced by this deadline. */
+static void sleep_then_spin(Pacer *pacer, long interval) {
+	long cap = interval / 8 < MAX_SPIN_MARGIN ? interval / 8 : MAX_SPIN_MARGIN;
+	if(pacer->spin_margin > cap) {
+		pacer->spin_margin = cap;
+	}
+
+	struct timespec wake_at = pacer->deadline;
+	add_nanoseconds(&wake_at, -pacer->spin_margin);
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if(nanoseconds_between(&wake_at, &now) < 0) {
+		int success;
+		do {
+			success = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake_at, NULL);
+		} while(success == EINTR);
+		if(success != 0) {
+			fprintf(stderr, "WARNING: clock_nanosleep unable to sleep until the deadline.\n%s\n", strerror(success));
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		long late = nanoseconds_between(&wake_at, &now);
+		if(late > pacer->spin_margin) {
+			pacer->spin_margin = late + late / 4;
+		}
+		else {
+			pacer->spin_margin -= pacer->spin_margin / 64;
+		}
+		if(pacer->spin_margin > cap) {
+			pacer->spin_margin = cap;
+		}
+		if(pacer->spin_margin < MIN_SPIN_MARGIN) {
+			pacer->spin_margin = MIN_SPIN_MARGIN;
+		}
+	}
+	if(pacer->spin_margin >= cap) {
+		pacer->current.total_capped += interval;
+	}
+
+	struct timespec spin_start = now;
+	while(nanoseconds_between(&pacer->deadline, &now) < 0) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	}
+	pacer->current.total_spin += nanoseconds_between(&spin_start, &now);
+}
+
+/* Returns 1 if the wait was ended early by wake_pacer(). */
+static int wait_for_timer(Pacer *pacer) {
+	struct itimerspec timer;
+	memset(&timer, 0, sizeof(timer));
+	timer.it_value = pacer->deadline; /* fires straight away if the deadline has already passed */
+	timerfd_settime(pacer->timer_fd, TFD_TIMER_ABSTIME, &timer, NULL);
+
+	while(1) {
+		struct epoll_event events[2];
+		int count = epoll_wait(pacer->epoll_fd, events, 2, -1);
+		if(count == -1) {
+			if(errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "WARNING: epoll_wait unable to wait for the deadline.\n%s\n", strerror(errno));
+			return 0;
+		}
+
+		int woken = 0;
+		int i;
+		uint64_t value;
+		for(i = 0; i < count; ++i) {
+			if(events[i].data.fd == pacer->wake_fd) {
+				woken = read(pacer->wake_fd, &value, sizeof(value)) > 0;
+			}
+			else if(read(pacer->timer_fd, &value, sizeof(value)) > 0) {
+				return 0;
+			}
+		}
+		if(woken) {
+			return 1;
+		}
+	}
+}
+
+static void record_wait(Pacer *pacer, struct timespec *woken_at) {
+	long late = nanoseconds_between(&pacer->deadline, woken_at);
+	if(late < 0) {
+		pacer->current.undersleeps += 1;
+		return;
+	}
+
+	if(late > OVERSLEEP_TOLERANCE) {
+		pacer->current.oversleeps += 1;
+	}
+	int bucket = 0;
+	while(bucket < JITTER_BUCKETS - 1 && late >= jitter_limits[bucket]) {
+		++bucket;
+	}
+	pacer->current.jitter[bucket] += 1;
+	if(late > pacer->current.max_oversleep) {
+		pacer->current.max_oversleep = late;
+	}
+	pacer->current.total_oversleep += late;
+}
+
+/* Moves on to the next second's stats once a second of real time has passed, printing the last one's if asked to. */
+static void finish_second(Pacer *pacer, struct timespec *now) {
+	if(nanoseconds_between(&pacer->second_start, now) < NANOSECONDS_PER_SECOND) {
+		return;
+	}
+
+	pacer->last = pacer->current;
+	if(pacer->print_stats) {
+		PacingStats *stats = &pacer->last;
+		unsigned long slept = stats->deadlines - stats->missed;
+		fprintf(stderr, "Pacing: %lu deadlines, %lu missed, %lu overslept, %lu undersleeps, oversleep max %ld us mean %lld us\n",
+			stats->deadlines, stats->missed, stats->oversleeps, stats->undersleeps, stats->max_oversleep / 1000,
+			slept > 0 ? stats->total_oversleep / slept / 1000 : 0);
+
+		fprintf(stderr, "Jitter:");
+		int bucket;
+		for(bucket = 0; bucket < JITTER_BUCKETS - 1; ++bucket) {
+			fprintf(stderr, " <%ld us %lu,", jitter_limits[bucket] / 1000, stats->jitter[bucket]);
+		}
+		fprintf(stderr, " more %lu\n", stats->jitter[JITTER_BUCKETS - 1]);
+		if(pacer->mode == PACING_HYBRID) {
+			long elapsed = nanoseconds_between(&pacer->second_start, now);
+			fprintf(stderr, "Spinning: %.1f%% of the time, margin %ld us, held at its cap %.1f%% of the time\n", stats->total_spin * 100.0 / elapsed,
+				pacer->spin_margin / 1000, stats->total_capped * 100.0 / elapsed);
+		}
+	}
+
+	memset(&pacer->current, 0, sizeof(PacingStats));
+	pacer->second_start = *now;
+}
+
+void pace(Pacer *pacer, long nanoseconds) {
+	if(pacer->speed == 0) {
+		return; /* unthrottled */
+	}
+
+	long interval = (long)(nanoseconds / pacer->speed);
+	add_nanoseconds(&pacer->deadline, interval);
+	pacer->current.deadlines += 1;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if(nanoseconds_between(&pacer->deadline, &now) >= 0) {
+		pacer->current.missed += 1;
+		if(nanoseconds_between(&pacer->deadline, &now) > MAX_LAG) {
+			pacer->deadline = now; /* the host stalled, or cannot keep up. running flat out until it caught up would only make the game lurch */
+		}
+		finish_second(pacer, &now);
+		return;
+	}
+
+	int woken = 0;
+	switch(pacer->mode) {
+		case PACING_SLEEP:   sleep_until_deadline(pacer);       break;
+		case PACING_TIMERFD: woken = wait_for_timer(pacer);    break;
+		case PACING_HYBRID:  sleep_then_spin(pacer, interval); break;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if(!woken) {
+		record_wait(pacer, &now);
+	}
+	finish_second(pacer, &now);
+}
+
+void add_nanoseconds(struct timespec *time, long nanoseconds) {
+	time->tv_sec += nanoseconds / NANOSECONDS_PER_SECOND;
+	time->tv_nsec += nanoseconds % NANOSECONDS_PER_SECOND;
+	if(time->tv_nsec >= NANOSECONDS_PER_SECOND) {
+		time->tv_sec += 1;
+		time->tv_nsec -= NANOSECONDS_PER_SECOND;
+	}
+	else if(time->tv_nsec < 0) {
+		time->tv_sec -= 1;
+		time->tv_nsec += NANOSECONDS_PER_SECOND;
+	}
+}
+
+long nanoseconds_between(struct timespec *start, struct timespec *end) {
+	return (end->tv_sec - start->tv_sec) * NANOSECONDS_PER_SECOND + (end->tv_nsec - start->tv_nsec);
+}
@@ -0,0 +1,73 @@
+#ifndef SPINV_PACING
+#define SPINV_PACING
+
+#include <time.h>
+#include <semaphore.h>
+
+#define NANOSECONDS_PER_SECOND 1000000000L
+#define MAX_LAG 100000000L /* 100 ms. if the host falls further behind than this, give up on catching up and carry on from now */
+#define OVERSLEEP_TOLERANCE 100000L /* 100 us. waking up any later than this after a deadline counts as oversleeping */
+#define INITIAL_SPIN_MARGIN 500000L /* 500 us. how long before each deadline PACING_HYBRID stops sleeping and starts spinning, until it has seen how late sleeps run */
+#define MIN_SPIN_MARGIN 50000L
+#define MAX_SPIN_MARGIN 1000000L /* 1 ms, or an eighth of the time to the next deadline if that is less. a host whose sleeps run later than that is
+                                  * better off oversleeping now and then than spinning through a good part of every frame */
+#define JITTER_BUCKETS 8
+
+typedef enum {
+	PACING_SLEEP,   /* clock_nanosleep until each deadline */
+	PACING_TIMERFD, /* wait for a timerfd set to each deadline with epoll, which can also be woken early through an eventfd */
+	PACING_HYBRID   /* clock_nanosleep until shortly before each deadline, then spin on the clock for the rest */
+} PacingMode;
+
+/* How well deadlines were kept over one second of real time. */
+typedef struct {
+	unsigned long deadlines;   /* how many there were */
+	unsigned long missed;      /* how many had already passed by the time the emulation got to them, leaving nothing to sleep for */
+	unsigned long oversleeps;  /* how many were woken from more than OVERSLEEP_TOLERANCE late */
+	unsigned long undersleeps; /* how many were woken from early */
+	long max_oversleep;        /* in nanoseconds */
+	long long total_oversleep; /* in nanoseconds, over every deadline that was slept for */
+	long long total_spin;      /* in nanoseconds. PACING_HYBRID only */
+	long long total_capped;    /* in nanoseconds of paced time with the spin margin held at its cap, because sleeps ran later still. PACING_HYBRID only */
+	unsigned long jitter[JITTER_BUCKETS]; /* how many deadlines were woken from how late, bucketed by the limits in jitter_limits */
+} PacingStats;
+
+/* Keeps the emulation in step with real time. Emulated time is counted up as it runs, and each call to pace() waits until the same amount of
+ * real time has passed since pacing started. The deadline is absolute, so oversleeping once is made up for the next time.
+ * Only the CPU thread waits here, and PACING_TIMERFD's epoll set only holds the timer and the wake eventfd. Input and output deliberately stay
+ * off it: inputs already reach the game on exact cycles between batches, so waking for them early would change nothing, and frames go to the
+ * render thread so that drawing them never holds up the CPU. */
+typedef struct {
+	PacingMode mode;
+	double speed; /* how many times faster than real time to run. 0 never waits at all */
+	int print_stats; /* 1 to print each second's PacingStats as it finishes */
+	struct timespec deadline;
+	struct timespec second_start; /* when the second being counted in current began */
+	PacingStats current;
+	PacingStats last; /* the last full second. only to be read from the thread calling pace() */
+	long spin_margin; /* PACING_HYBRID only. in nanoseconds */
+	int timer_fd; /* PACING_TIMERFD only */
+	int wake_fd;
+	int epoll_fd;
+	sem_t parked; /* posted by wake_pacer(), for park_pacer() to wait on */
+} Pacer;
+
+void initialize_pacer(Pacer *pacer, PacingMode mode, double speed, int print_stats);
+void destroy_pacer(Pacer *pacer);
+
+/* Starts counting real time from now. Call just before the first call to pace(). */
+void start_pacer(Pacer *pacer);
+/* Waits until nanoseconds more of emulated time, scaled by the speed, have passed in real time since the last call. */
+void pace(Pacer *pacer, long nanoseconds);
+/* Waits with no deadline at all, until wake_pacer() is called. For when nothing the emulation could do would ever make a difference. */
+void park_pacer(Pacer *pacer);
+/* Ends a wait in pace() early, from any thread, so that the emulation can notice it has been asked to stop. Only PACING_TIMERFD waits can be
+ * woken. The others last at most a frame anyway. Ends a wait in park_pacer() in any mode, even one that has not begun yet. */
+void wake_pacer(Pacer *pacer);
+
+/* nanoseconds can be negative */
+void add_nanoseconds(struct timespec *time, long nanoseconds);
+/* how long after start end is. negative if it comes first */
+long nanoseconds_between(struct timespec *start, struct timespec *end);
+
+#endif
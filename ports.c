@@ -67,30 +67,9 @@ uint8_t read_input1() {
 	 *   bit 5 = 1P left
 	 *   bit 6 = 1P right
 	 *   bit 7 = not connected (so just return 0?)
+	 * The input word is already laid out this way. Nothing else is read alongside it, so a relaxed load is enough.
 	 */
-	uint8_t credit = game_control->credit;
-	PlayerControl p1_control = game_control->player1;
-	PlayerControl p2_control = game_control->player2;
-	uint8_t status = 0x08;
-	if(credit == 1) {
-		status |= 0x01;
-	}
-	if(p2_control.start == 1) {
-		status |= 0x02;
-	}
-	if(p1_control.start == 1) {
-		status |= 0x04;
-	}
-	if(p1_control.fire == 1) {
-		status |= 0x10;
-	}
-	if(p1_control.left == 1) {
-		status |= 0x20;
-	}
-	if(p1_control.right == 1) {
-		status |= 0x40;
-	}
-	return status;
+	return (atomic_load_explicit(&game_control->inputs, memory_order_relaxed) >> INPUT_PORT1_SHIFT) & 0xff;
 }
 
 uint8_t read_input2() {
@@ -103,20 +82,9 @@ uint8_t read_input2() {
 	 *   bit 6 = 2P right
 	 *   bit 7 = coin info displayed in demo screen (0: ON)
 	 */
-	PlayerControl p2_control = game_control->player2;
-	uint8_t status = 0x00;
 	/* TODO: Implement bits 0-3 */
-	if(p2_control.fire == 1) {
-		status |= 0x10;
-	}
-	if(p2_control.left == 1) {
-		status |= 0x20;
-	}
-	if(p2_control.right == 1) {
-		status |= 0x40;
-	}
 	/* TODO: implement bit 7 */
-	return status;
+	return (atomic_load_explicit(&game_control->inputs, memory_order_relaxed) >> INPUT_PORT2_SHIFT) & 0xff;
 }
 
 void write_sound0(uint8_t data) {
@@ -0,0 +1,102 @@
+#include "present.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const uint32_t overlay_colours[NUM_OF_OVERLAY_COLOURS] = {
+	[OVERLAY_WHITE] = 0xffffff,
+	[OVERLAY_RED] = 0xff3030,
+	[OVERLAY_GREEN] = 0x30ff30,
+};
+
+/* The gels, as rectangles of the upright image, in rows and 8 pixel wide cells. Anything not under one is white. */
+static const struct {
+	int top, bottom; /* rows, bottom excluded */
+	int left, right; /* cells, right excluded */
+	OverlayColour colour;
+} gels[] = {
+	{ 32,  64, 0, PRESENT_CELLS, OVERLAY_RED },   /* the saucer */
+	{ 184, 240, 0, PRESENT_CELLS, OVERLAY_GREEN }, /* the shields and the player */
+	{ 240, 256, 2, 17, OVERLAY_GREEN },           /* the spare cannons beside the count of lives, but not the credits */
+};
+
+static int build_table(Presenter *presenter, int scale) {
+	int width = 8 * scale;
+	uint32_t *table = malloc(sizeof(uint32_t) * NUM_OF_OVERLAY_COLOURS * 256 * width);
+	if(table == NULL) {
+		return -1;
+	}
+
+	int colour, byte, bit, i;
+	uint32_t *entry = table;
+	for(colour = 0; colour < NUM_OF_OVERLAY_COLOURS; ++colour) {
+		for(byte = 0; byte < 256; ++byte) {
+			/* the leftmost pixel is the lowest bit, and lit pixels are 0 bits */
+			for(bit = 0; bit < 8; ++bit) {
+				uint32_t pixel = (byte >> bit) & 0x1 ? 0x000000 : overlay_colours[colour];
+				for(i = 0; i < scale; ++i) {
+					*entry++ = pixel;
+				}
+			}
+		}
+	}
+
+	free(presenter->table);
+	presenter->table = table;
+	presenter->scale = scale;
+	return 0;
+}
+
+int initialize_presenter(Presenter *presenter, int scale) {
+	int row, cell;
+	size_t gel;
+
+	memset(presenter->overlay, OVERLAY_WHITE, sizeof(presenter->overlay));
+	for(gel = 0; gel < sizeof(gels) / sizeof(gels[0]); ++gel) {
+		/* clipped to the screen, so that a gel can never colour anything outside it */
+		int bottom = gels[gel].bottom < PRESENT_HEIGHT ? gels[gel].bottom : PRESENT_HEIGHT;
+		int right = gels[gel].right < PRESENT_CELLS ? gels[gel].right : PRESENT_CELLS;
+		for(row = gels[gel].top; row < bottom; ++row) {
+			for(cell = gels[gel].left; cell < right; ++cell) {
+				presenter->overlay[row][cell] = gels[gel].colour;
+			}
+		}
+	}
+
+	presenter->table = NULL;
+	return build_table(presenter, scale < 1 ? 1 : scale);
+}
+
+void destroy_presenter(Presenter *presenter) {
+	free(presenter->table);
+	presenter->table = NULL;
+}
+
+int set_presenter_scale(Presenter *presenter, int scale) {
+	if(scale < 1) {
+		scale = 1;
+	}
+	if(scale == presenter->scale) {
+		return 0;
+	}
+	return build_table(presenter, scale);
+}
+
+void present_image(const Presenter *presenter, const uint8_t *image, uint32_t *pixels, int stride, uint32_t blocks) {
+	int scale = presenter->scale;
+	size_t width = 8 * scale; /* pixels each byte of the image becomes, across */
+	int row, cell, i;
+
+	for(row = 0; row < PRESENT_HEIGHT; ++row) {
+		uint8_t *out = (uint8_t *)pixels + (size_t)row * scale * stride;
+		for(cell = 0; cell < PRESENT_CELLS; ++cell) {
+			if(!(blocks & (1u << cell))) {
+				continue;
+			}
+			const uint32_t *entry = presenter->table + (presenter->overlay[row][cell] * 256 + image[row * IMAGE_STRIDE + cell]) * width;
+			for(i = 0; i < scale; ++i) {
+				memcpy((uint32_t *)(out + i * stride) + cell * width, entry, width * sizeof(uint32_t));
+			}
+		}
+	}
+}
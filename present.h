@@ -0,0 +1,41 @@
+#ifndef SPINV_PRESENT
+#define SPINV_PRESENT
+
+#include "render.h"
+
+#include <stdint.h>
+
+/* the upright screen, in pixels at a scale of 1: one column for each VRAM line. IMAGE_STRIDE may be padded past it, and the padding is never shown */
+#define PRESENT_WIDTH VRAM_LINES
+#define PRESENT_HEIGHT IMAGE_ROWS
+#define PRESENT_CELLS (PRESENT_WIDTH / 8) /* 8 pixel wide cells to a row, each one byte of the image and one rotation block */
+
+/* The cabinet's monitor is black and white. Strips of coloured gel stuck over the glass tint the saucer's row red, and the shields, the player
+ * and the lives left along the bottom green. */
+typedef enum {
+	OVERLAY_WHITE,
+	OVERLAY_RED,
+	OVERLAY_GREEN,
+	NUM_OF_OVERLAY_COLOURS
+} OverlayColour;
+
+/* Turns the renderer's 1-bit images into 32-bit RGB pixels, scaled up by a whole number and coloured as the overlay tints them. Both are done by
+ * looking each byte of the image up in a table, which holds the 8 pixels it becomes, already widened to the scale, for each overlay colour. */
+typedef struct {
+	int scale;
+	uint32_t *table; /* 8 * scale pixels for every overlay colour and byte value, in that order */
+	uint8_t overlay[PRESENT_HEIGHT][PRESENT_CELLS]; /* the OverlayColour of each 8 pixel wide cell of the image */
+} Presenter;
+
+/* Returns 0 on success, or -1 if the table could not be allocated. */
+int initialize_presenter(Presenter *presenter, int scale);
+void destroy_presenter(Presenter *presenter);
+/* Rebuilds the table for a new scale, if it is not the one already in use. Returns 0 on success. On failure the old scale is kept. */
+int set_presenter_scale(Presenter *presenter, int scale);
+
+/* Draws the blocks of image set in blocks into pixels, which must hold PRESENT_WIDTH * scale by PRESENT_HEIGHT * scale pixels, stride bytes
+ * apart from one row to the next. Each block is an 8 pixel wide strip of the image, the same as a rotation block. Pixels are 0x00RRGGBB, as
+ * Cairo's RGB24 format has them. */
+void present_image(const Presenter *presenter, const uint8_t *image, uint32_t *pixels, int stride, uint32_t blocks);
+
+#endif
@@ -0,0 +1,254 @@
+/* Static recompiler for Intel 8080 ROM images.
+ * Reads a ROM, finds every instruction that can be reached from the reset and RST vectors by following jumps and calls, and writes out C
+ * source with one label per reachable instruction. cpu8080.c compiles the result in as an alternate core when CPU_RECOMPILED is defined.
+ * Jumps to addresses it cannot know ahead of time (RET, PCHL, interrupts) go through a dispatcher, which hands anything outside the
+ * recompiled code over to emulate().
+ */
+
+#include "cpu8080.h"
+#include "disassembler8080.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define EXIT_IO_ERROR 3
+
+/* The statement that executes each opcode, straight out of the opcode table. IMM8 and IMM16 are replaced with the instruction's operand. */
+static const char *handlers[NUM_OF_OPCODES] = {
+	#define OP(code, timing, ...) [code] = #__VA_ARGS__,
+	#include "cpu8080_ops.h"
+};
+
+/* 1 for the opcodes whose handlers return the cycles they took, rather than always taking what opCycles says */
+#define COUNTS_OWN_CYCLES_FIXED 0
+#define COUNTS_OWN_CYCLES_TIMED 1
+static const uint8_t counts_own_cycles[NUM_OF_OPCODES] = {
+	#define OP(code, timing, ...) [code] = COUNTS_OWN_CYCLES_##timing,
+	#include "cpu8080_ops.h"
+};
+
+static uint8_t rom[ROM_SIZE];
+static long rom_size;
+static uint8_t reachable[ROM_SIZE];
+static uint8_t opLengths[NUM_OF_OPCODES]; /* the same lengths the interpreter decodes with */
+
+
+static int is_jump(uint8_t op) {
+	return op == 0xc3 || op == 0xc2 || op == 0xca || op == 0xd2 || op == 0xda || op == 0xe2 || op == 0xea || op == 0xf2 || op == 0xfa;
+}
+
+static int is_call(uint8_t op) {
+	return op == 0xcd || op == 0xc4 || op == 0xcc || op == 0xd4 || op == 0xdc || op == 0xe4 || op == 0xec || op == 0xf4 || op == 0xfc;
+}
+
+static int is_conditional_return(uint8_t op) {
+	return op == 0xc0 || op == 0xc8 || op == 0xd0 || op == 0xd8 || op == 0xe0 || op == 0xe8 || op == 0xf0 || op == 0xf8;
+}
+
+static int is_rst(uint8_t op) {
+	return (op & 0xc7) == 0xc7;
+}
+
+/* whether execution can carry on to the next instruction after this one */
+static int falls_through(uint8_t op) {
+	return handlers[op] != NULL && op != 0xc3 && op != 0xc9 && op != 0xe9; /* JMP, RET, PCHL */
+}
+
+/* whether the instruction can leave PC anywhere but the next instruction, or stop the CPU */
+static int changes_flow(uint8_t op) {
+	return is_jump(op) || is_call(op) || is_conditional_return(op) || is_rst(op) || op == 0xc9 || op == 0xe9 || op == 0x76;
+}
+
+/* the address a jump, call or RST goes to, if it is known ahead of time. -1 otherwise */
+static long static_target(uint16_t addr) {
+	uint8_t op = rom[addr];
+	if(is_jump(op) || is_call(op)) {
+		return rom[addr + 1] | (rom[addr + 2] << 8);
+	}
+	if(is_rst(op)) {
+		return op & 0x38;
+	}
+	return -1;
+}
+
+static int translatable(long addr) {
+	return addr >= 0 && addr < rom_size && addr + opLengths[rom[addr]] <= rom_size;
+}
+
+/* Marks everything reachable from addr. Calls are assumed to return to the instruction after them. */
+static void trace(long addr) {
+	long *worklist = malloc(sizeof(long) * (2 * ROM_SIZE + 1)); /* every address is expanded at most once, into at most two more */
+	int pending = 0;
+
+	worklist[pending++] = addr;
+	while(pending > 0) {
+		addr = worklist[--pending];
+		if(!translatable(addr) || reachable[addr]) {
+			continue;
+		}
+		reachable[addr] = 1;
+
+		uint8_t op = rom[addr];
+		long target = static_target(addr);
+		if(target >= 0) {
+			worklist[pending++] = target;
+		}
+		if(falls_through(op)) {
+			worklist[pending++] = addr + opLengths[op];
+		}
+	}
+
+	free(worklist);
+}
+
+/* writes out the handler statement for the instruction at addr, with its operand in place of IMM8 or IMM16 */
+static void write_statement(FILE *out, uint16_t addr) {
+	uint8_t op = rom[addr];
+	const char *text = handlers[op];
+	char operand[8] = "";
+
+	if(opLengths[op] == 3) {
+		sprintf(operand, "0x%.2x%.2x", rom[addr + 2], rom[addr + 1]);
+	}
+	else if(opLengths[op] == 2) {
+		sprintf(operand, "0x%.2x", rom[addr + 1]);
+	}
+
+	while(*text != '\0') {
+		if(strncmp(text, "IMM16", 5) == 0) {
+			fputs(operand, out);
+			text += 5;
+		}
+		else if(strncmp(text, "IMM8", 4) == 0) {
+			fputs(operand, out);
+			text += 4;
+		}
+		else {
+			fputc(*text++, out);
+		}
+	}
+}
+
+static void write_instruction(FILE *out, uint16_t addr) {
+	uint8_t op = rom[addr];
+	uint16_t next = addr + opLengths[op];
+	char disassembled[32];
+
+	disassemble(&rom[addr], disassembled);
+	fprintf(out, "L%.4x: /* %s */\n", addr, disassembled);
+
+	if(handlers[op] == NULL) {
+		fprintf(out, "\tcycles += emulate(cpu, mem, interrupts); /* not implemented - let the interpreter report it */\n\tgoto dispatch;\n");
+		return;
+	}
+
+	fprintf(out, "\tcpu->pc = 0x%.4x;\n\t", next);
+	if(counts_own_cycles[op]) {
+		fprintf(out, "cycles += ");
+		write_statement(out, addr);
+		fprintf(out, ";\n");
+	}
+	else {
+		write_statement(out, addr);
+		fprintf(out, ";\n\tcycles += opCycles[0x%.2x];\n", op);
+	}
+
+	if(changes_flow(op)) {
+		long target = static_target(addr);
+		if(target >= 0 && translatable(target)) {
+			fprintf(out, "\tif(cpu->pc == 0x%.4lx && cycles < budget) {\n\t\tgoto L%.4lx;\n\t}\n", target, target);
+		}
+		fprintf(out, "\tgoto dispatch;\n");
+		return;
+	}
+
+	fprintf(out, "\tif(cycles >= budget) {\n\t\treturn cycles;\n\t}\n");
+
+	/* instructions are written out in address order, so the next one can simply be fallen into, unless one overlapping it comes first */
+	long following = addr + 1;
+	while(following < rom_size && !reachable[following]) {
+		++following;
+	}
+	if(!translatable(next) || !reachable[next]) {
+		fprintf(out, "\tgoto dispatch;\n");
+	}
+	else if(following != next) {
+		fprintf(out, "\tgoto L%.4x;\n", next);
+	}
+}
+
+static void write_core(FILE *out, char *rom_name) {
+	long addr;
+
+	fprintf(out, "/* Generated by spinv_recompile from %s. Do not edit - regenerate it instead.\n", rom_name);
+	fprintf(out, " * This file is not compiled on its own: cpu8080.c includes it when CPU_RECOMPILED is defined. */\n\n");
+	fprintf(out, "static unsigned long execute_recompiled(CPU *cpu, uint8_t *mem, Interrupt *interrupts, unsigned long budget) {\n");
+	fprintf(out, "\tunsigned long cycles = 0;\n\n");
+
+	fprintf(out, "dispatch:\n");
+	fprintf(out, "\tif(cycles >= budget || cpu->halted) {\n\t\treturn cycles;\n\t}\n");
+	fprintf(out, "\tif(!cpu->has_interrupt) {\n");
+	fprintf(out, "\t\tswitch(cpu->pc) {\n");
+	for(addr = 0; addr < rom_size; ++addr) {
+		if(reachable[addr]) {
+			fprintf(out, "\t\t\tcase 0x%.4lx: goto L%.4lx;\n", addr, addr);
+		}
+	}
+	fprintf(out, "\t\t}\n\t}\n");
+	fprintf(out, "\tcycles += emulate(cpu, mem, interrupts); /* interrupts, RAM, and anything the trace did not reach */\n");
+	fprintf(out, "\tgoto dispatch;\n\n");
+
+	for(addr = 0; addr < rom_size; ++addr) {
+		if(reachable[addr]) {
+			write_instruction(out, addr);
+		}
+	}
+
+	fprintf(out, "}\n");
+}
+
+void help(char *program_name) {
+	fprintf(stdout, "Usage: %s <rom> <output.c>\n", program_name);
+}
+
+int main(int argc, char **argv) {
+	if(argc < 3) {
+		help(argv[0]);
+		return EXIT_SUCCESS;
+	}
+
+	FILE *file = fopen(argv[1], "rb");
+	if(file == NULL) {
+		fprintf(stderr, "ERROR: unable to open file %s\n%s\n", argv[1], strerror(errno));
+		return EXIT_IO_ERROR;
+	}
+	rom_size = fread(rom, sizeof(uint8_t), ROM_SIZE, file);
+	fclose(file);
+
+	initializeOpLengths(opLengths);
+
+	/* the reset vector, and the RST vectors that interrupts enter through */
+	int vector;
+	for(vector = 0; vector < 0x40; vector += 8) {
+		trace(vector);
+	}
+
+	FILE *out = fopen(argv[2], "w");
+	if(out == NULL) {
+		fprintf(stderr, "ERROR: unable to open file %s\n%s\n", argv[2], strerror(errno));
+		return EXIT_IO_ERROR;
+	}
+	write_core(out, argv[1]);
+	fclose(out);
+
+	long count = 0;
+	long addr;
+	for(addr = 0; addr < rom_size; ++addr) {
+		count += reachable[addr];
+	}
+	fprintf(stdout, "Recompiled %ld instructions from %ld bytes of ROM.\n", count, rom_size);
+
+	return EXIT_SUCCESS;
+}
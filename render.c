@@ -0,0 +1,69 @@
+#include "render.h"
+
+#include <string.h>
+#include <errno.h>
+
+static void *render_frames(void *data) {
+	Renderer *renderer = (Renderer *)data;
+	FrameQueue *frames = renderer->frames;
+
+	while(1) {
+		while(sem_wait(&frames->ready) == -1 && errno == EINTR) {
+			continue;
+		}
+		if(atomic_load_explicit(&renderer->stop, memory_order_acquire)) {
+			break;
+		}
+		if(!take_triple_buffer(&frames->buffer)) {
+			continue; /* it was already taken along with an earlier one */
+		}
+
+		/* if a frame was skipped, the dirty lines of the frame in between are unknown, so everything is drawn again */
+		Frame *frame = &frames->frames[frames->buffer.front];
+		uint32_t blocks = ROTATION_ALL_BLOCKS;
+		if(frame->number == renderer->drawn + 1) {
+			int line;
+			blocks = 0;
+			for(line = 0; line < NUM_OF_VRAM_LINES; ++line) {
+				if(frame->dirty[line]) {
+					blocks |= 1u << (line / 8);
+				}
+			}
+		}
+		rotate_frame(frame->vram, renderer->pixels, IMAGE_STRIDE, blocks);
+		renderer->drawn = frame->number;
+
+		Image *image = &renderer->images[renderer->buffer.back];
+		memcpy(image->pixels, renderer->pixels, IMAGE_SIZE);
+		image->blocks = blocks;
+		image->number = frame->number;
+		publish_triple_buffer(&renderer->buffer);
+	}
+
+	return NULL;
+}
+
+int start_renderer(Renderer *renderer, FrameQueue *frames) {
+	int i;
+
+	initialize_rotation();
+
+	renderer->frames = frames;
+	for(i = 0; i < 3; ++i) {
+		memset(renderer->images[i].pixels, 0xff, IMAGE_SIZE); /* nothing lit */
+		renderer->images[i].blocks = ROTATION_ALL_BLOCKS;
+		renderer->images[i].number = 0;
+	}
+	initialize_triple_buffer(&renderer->buffer);
+	memset(renderer->pixels, 0xff, IMAGE_SIZE);
+	renderer->drawn = 0;
+	atomic_init(&renderer->stop, 0);
+
+	return pthread_create(&renderer->thread, NULL, render_frames, renderer);
+}
+
+void stop_renderer(Renderer *renderer) {
+	atomic_store_explicit(&renderer->stop, 1, memory_order_release);
+	sem_post(&renderer->frames->ready);
+	pthread_join(renderer->thread, NULL);
+}
@@ -0,0 +1,40 @@
+#ifndef SPINV_RENDER
+#define SPINV_RENDER
+
+#include "emulator.h"
+#include "rotation.h"
+#include "triplebuffer.h"
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define IMAGE_STRIDE (((VRAM_LINES + 31) / 32) * 4) /* bytes to a row of an image. rows are padded out to 32 bits, as Cairo lays out A1 images */
+#define IMAGE_ROWS (VRAM_LINE_BYTES * 8)
+#define IMAGE_SIZE (IMAGE_STRIDE * IMAGE_ROWS)
+
+/* A frame rotated upright, ready to be shown just as it is. */
+typedef struct {
+	uint8_t pixels[IMAGE_SIZE]; /* laid out as rotate_frame() describes, IMAGE_STRIDE bytes to a row */
+	uint32_t blocks; /* the rotation blocks that differ from the image of the frame before, if that was the one shown last */
+	unsigned long number; /* the number of the frame it was drawn from. 0 until the first one */
+} Image;
+
+/* The render thread takes each frame the CPU thread finishes, rotates it upright, and hands it on to the display through another triple buffer:
+ * the render thread fills images[buffer.back], and the display shows images[buffer.front]. */
+typedef struct {
+	FrameQueue *frames;
+	Image images[3];
+	TripleBuffer buffer;
+	uint8_t pixels[IMAGE_SIZE]; /* the newest frame drawn so far, so that only the blocks that change need drawing again. render thread only */
+	unsigned long drawn; /* the number of the frame in pixels. render thread only */
+	atomic_int stop;
+	pthread_t thread;
+} Renderer;
+
+/* picks a rotation kernel and starts the render thread, which draws every frame published to frames. Returns 0 on success */
+int start_renderer(Renderer *renderer, FrameQueue *frames);
+/* stops the render thread, and waits for it to finish. Call once the CPU thread has stopped publishing frames */
+void stop_renderer(Renderer *renderer);
+
+#endif
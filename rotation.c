@@ -0,0 +1,201 @@
+#include "rotation.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ROTATION_X86 /* GCC and Clang can build SSE2 and AVX2 functions into one binary, and check for them at run time */
+#include <immintrin.h>
+#endif
+
+/* Every output row is one bit position of one VRAM column, read across all 224 lines, so the rotation is made of 8x8 bit-matrix transposes:
+ * 8 bytes from 8 neighbouring lines in, 8 bytes for 8 neighbouring rows out. Column c holds the pixels 8 * (31 - c) to 8 * (31 - c) + 7 rows
+ * from the top, with its highest bit the topmost. */
+#define ROW_OF_COLUMN(column) ((VRAM_LINE_BYTES - 1 - (column)) * 8)
+
+static const char *kernel_names[] = {
+	[ROTATION_SCALAR] = "scalar",
+	[ROTATION_SSE2] = "SSE2",
+	[ROTATION_AVX2] = "AVX2",
+};
+
+/* Transposes the 8x8 bit matrix held with row r in byte r and column b in bit b, so that byte b ends up holding bit b of every row.
+ * Swaps 1x1, then 2x2, then 4x4 blocks across the diagonal. */
+static inline uint64_t transpose_8x8(uint64_t x) {
+	uint64_t t;
+	t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaULL;
+	x ^= t ^ (t << 7);
+	t = (x ^ (x >> 14)) & 0x0000cccc0000ccccULL;
+	x ^= t ^ (t << 14);
+	t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ULL;
+	x ^= t ^ (t << 28);
+	return x;
+}
+
+static void rotate_scalar(const uint8_t *vram, uint8_t *image, int stride, uint32_t blocks) {
+	int block, column, i;
+	for(block = 0; block < ROTATION_BLOCKS; ++block) {
+		if(!(blocks & (1u << block))) {
+			continue;
+		}
+		const uint8_t *lines = vram + block * 8 * VRAM_LINE_BYTES;
+		for(column = 0; column < VRAM_LINE_BYTES; ++column) {
+			uint64_t matrix = 0;
+			for(i = 0; i < 8; ++i) {
+				matrix |= (uint64_t)lines[i * VRAM_LINE_BYTES + column] << (8 * i);
+			}
+			matrix = ~transpose_8x8(matrix);
+
+			/* byte b now holds bit b of the column, which is 7 - b rows down */
+			uint8_t *out = image + ROW_OF_COLUMN(column) * stride + block;
+			for(i = 0; i < 8; ++i) {
+				out[i * stride] = matrix >> (8 * (7 - i));
+			}
+		}
+	}
+}
+
+#ifdef ROTATION_X86
+/* The SIMD kernels transpose bytes rather than bits. 16 lines of 16 columns are loaded one line to a register, and turned around into one column
+ * to a register. Then each bit of the column, from the highest down, is a row: movemask gathers the top bit of every byte, which is one output
+ * bit per line, already in order, and adding the register to itself moves the next bit up. */
+
+/* Transposes a 16x16 matrix of bytes, one row to a register. Each round interleaves register i with register i + 8, which rotates the 4 bits of
+ * the register number and the 4 bits of the byte position around by one between them. After four rounds they have swapped places. */
+__attribute__((target("sse2")))
+static inline void transpose_16x16_sse2(__m128i *rows) {
+	__m128i interleaved[16];
+	int round, i;
+	for(round = 0; round < 4; ++round) {
+		for(i = 0; i < 8; ++i) {
+			interleaved[2 * i] = _mm_unpacklo_epi8(rows[i], rows[i + 8]);
+			interleaved[2 * i + 1] = _mm_unpackhi_epi8(rows[i], rows[i + 8]);
+		}
+		memcpy(rows, interleaved, sizeof(interleaved));
+	}
+}
+
+__attribute__((target("sse2")))
+static void rotate_sse2(const uint8_t *vram, uint8_t *image, int stride, uint32_t blocks) {
+	int group, half, column, i;
+	for(group = 0; group < VRAM_LINES / 16; ++group) {
+		if(!(blocks & (0x3u << (group * 2)))) {
+			continue;
+		}
+		for(half = 0; half < VRAM_LINE_BYTES / 16; ++half) {
+			__m128i rows[16];
+			for(i = 0; i < 16; ++i) {
+				rows[i] = _mm_loadu_si128((const __m128i *)(vram + (group * 16 + i) * VRAM_LINE_BYTES + half * 16));
+			}
+			transpose_16x16_sse2(rows);
+
+			for(column = 0; column < 16; ++column) {
+				uint8_t *out = image + ROW_OF_COLUMN(half * 16 + column) * stride + group * 2;
+				__m128i bits = rows[column];
+				for(i = 0; i < 8; ++i) {
+					uint16_t row = ~_mm_movemask_epi8(bits);
+					memcpy(out + i * stride, &row, sizeof(row));
+					bits = _mm_add_epi8(bits, bits);
+				}
+			}
+		}
+	}
+}
+
+/* AVX2 unpacks only interleave within each 128-bit half, so this is two of the transposes above side by side. */
+__attribute__((target("avx2")))
+static inline void transpose_16x16_avx2(__m256i *rows) {
+	__m256i interleaved[16];
+	int round, i;
+	for(round = 0; round < 4; ++round) {
+		for(i = 0; i < 8; ++i) {
+			interleaved[2 * i] = _mm256_unpacklo_epi8(rows[i], rows[i + 8]);
+			interleaved[2 * i + 1] = _mm256_unpackhi_epi8(rows[i], rows[i + 8]);
+		}
+		memcpy(rows, interleaved, sizeof(interleaved));
+	}
+}
+
+/* The low half of each register takes the first 16 of a group of 32 lines, and the high half the other 16, so that each movemask makes 32
+ * output bits in a row. */
+__attribute__((target("avx2")))
+static void rotate_avx2(const uint8_t *vram, uint8_t *image, int stride, uint32_t blocks) {
+	int group, half, column, i;
+	for(group = 0; group < VRAM_LINES / 32; ++group) {
+		if(!(blocks & (0xfu << (group * 4)))) {
+			continue;
+		}
+		for(half = 0; half < VRAM_LINE_BYTES / 16; ++half) {
+			__m256i rows[16];
+			for(i = 0; i < 16; ++i) {
+				const uint8_t *line = vram + (group * 32 + i) * VRAM_LINE_BYTES + half * 16;
+				__m128i low = _mm_loadu_si128((const __m128i *)line);
+				__m128i high = _mm_loadu_si128((const __m128i *)(line + 16 * VRAM_LINE_BYTES));
+				rows[i] = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+			}
+			transpose_16x16_avx2(rows);
+
+			for(column = 0; column < 16; ++column) {
+				uint8_t *out = image + ROW_OF_COLUMN(half * 16 + column) * stride + group * 4;
+				__m256i bits = rows[column];
+				for(i = 0; i < 8; ++i) {
+					uint32_t row = ~(uint32_t)_mm256_movemask_epi8(bits);
+					memcpy(out + i * stride, &row, sizeof(row));
+					bits = _mm256_add_epi8(bits, bits);
+				}
+			}
+		}
+	}
+}
+#endif
+
+static void (*rotate)(const uint8_t *vram, uint8_t *image, int stride, uint32_t blocks) = rotate_scalar;
+
+static int supported(RotationKernel kernel) {
+	switch(kernel) {
+		case ROTATION_SCALAR:
+			return 1;
+		#ifdef ROTATION_X86
+		case ROTATION_SSE2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("sse2");
+		case ROTATION_AVX2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2");
+		#endif
+		default:
+			return 0;
+	}
+}
+
+RotationKernel use_rotation_kernel(RotationKernel kernel) {
+	if(!supported(kernel)) {
+		kernel = ROTATION_SCALAR;
+	}
+
+	switch(kernel) {
+		#ifdef ROTATION_X86
+		case ROTATION_SSE2: rotate = rotate_sse2; break;
+		case ROTATION_AVX2: rotate = rotate_avx2; break;
+		#endif
+		default: rotate = rotate_scalar; break;
+	}
+	return kernel;
+}
+
+RotationKernel initialize_rotation(void) {
+	if(supported(ROTATION_AVX2)) {
+		return use_rotation_kernel(ROTATION_AVX2);
+	}
+	if(supported(ROTATION_SSE2)) {
+		return use_rotation_kernel(ROTATION_SSE2);
+	}
+	return use_rotation_kernel(ROTATION_SCALAR);
+}
+
+const char *rotation_kernel_name(RotationKernel kernel) {
+	return kernel_names[kernel];
+}
+
+void rotate_frame(const uint8_t *vram, uint8_t *image, int stride, uint32_t blocks) {
+	rotate(vram, image, stride, blocks);
+}
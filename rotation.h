@@ -0,0 +1,31 @@
+#ifndef SPINV_ROTATION
+#define SPINV_ROTATION
+
+#include <stdint.h>
+
+/* VRAM holds the screen as the monitor scans it: 224 lines of 32 bytes, each byte 8 pixels with the lowest bit first. The monitor is mounted
+ * rotated 90 degrees counterclockwise in the cabinet, so each line is a column on the screen, drawn from the bottom up. */
+#define VRAM_LINES 224
+#define VRAM_LINE_BYTES 32
+#define ROTATION_BLOCKS (VRAM_LINES / 8) /* VRAM is rotated in blocks of 8 lines, which make 8 pixel wide strips of the screen */
+#define ROTATION_ALL_BLOCKS ((1u << ROTATION_BLOCKS) - 1)
+
+typedef enum {
+	ROTATION_SCALAR, /* 8x8 bit-matrix transposes in a 64-bit word. runs anywhere */
+	ROTATION_SSE2,   /* transposes 16 lines of bytes at a time, then pulls each output row out of them with movemask */
+	ROTATION_AVX2    /* the same, 32 lines at a time */
+} RotationKernel;
+
+/* Picks the fastest kernel the host CPU supports, and returns which one it was. Call once before rotate_frame(). */
+RotationKernel initialize_rotation(void);
+/* Same, but uses kernel, as long as the host supports it. Returns the kernel actually in use. */
+RotationKernel use_rotation_kernel(RotationKernel kernel);
+const char *rotation_kernel_name(RotationKernel kernel);
+
+/* Turns a frame of VRAM into the upright 224x256 1-bit image the cabinet shows, as a Cairo A1 surface lays it out: one row of 28 bytes after
+ * another, stride bytes apart, with the leftmost pixel in the lowest bit. Lit pixels come out as 0 bits, as the display has always drawn them.
+ * Only the blocks with their bit set in blocks need be redrawn; the rest of the image is assumed to be up to date already, though the SIMD
+ * kernels may redraw some of it anyway. */
+void rotate_frame(const uint8_t *vram, uint8_t *image, int stride, uint32_t blocks);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef SPINV_TRIPLEBUFFER
+#define SPINV_TRIPLEBUFFER
+
+#include <stdatomic.h>
+
+#define TRIPLE_BUFFER_FRESH 0x4 /* set on middle while it holds something the reader has not taken yet */
+
+/* Hands buffers from one writer thread to one reader thread without either ever waiting for the other. Of three buffers, the writer owns
+ * back and fills it, the reader owns front and reads it, and middle is passed between them: publishing swaps back for middle, and taking swaps
+ * middle for front. The reader always gets the newest buffer published, and any it was too slow to take are simply skipped over.
+ * The buffers themselves are kept by the user, in an array of three indexed by back and front. */
+typedef struct {
+	atomic_uint middle; /* the index of the buffer in between, with TRIPLE_BUFFER_FRESH if it was published since the reader last took one */
+	unsigned int back;  /* only to be used by the writer */
+	unsigned int front; /* only to be used by the reader */
+} TripleBuffer;
+
+static inline void initialize_triple_buffer(TripleBuffer *buffer) {
+	buffer->back = 0;
+	atomic_init(&buffer->middle, 1);
+	buffer->front = 2;
+}
+
+/* Makes back, once it has been filled, the newest buffer for the reader to take. back is then another buffer, ready to be filled. */
+static inline void publish_triple_buffer(TripleBuffer *buffer) {
+	buffer->back = atomic_exchange_explicit(&buffer->middle, buffer->back | TRIPLE_BUFFER_FRESH, memory_order_acq_rel) & ~TRIPLE_BUFFER_FRESH;
+}
+
+/* Makes front the newest buffer published, and returns 1. If nothing has been published since the last time, front stays as it is, and 0 is
+ * returned. */
+static inline int take_triple_buffer(TripleBuffer *buffer) {
+	if(!(atomic_load_explicit(&buffer->middle, memory_order_relaxed) & TRIPLE_BUFFER_FRESH)) {
+		return 0;
+	}
+	buffer->front = atomic_exchange_explicit(&buffer->middle, buffer->front, memory_order_acq_rel) & ~TRIPLE_BUFFER_FRESH;
+	return 1;
+}
+
+#endif